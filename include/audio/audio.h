@@ -11,12 +11,18 @@
 
 #pragma once
 
+#include "audio/mixer.h"
+#include "audio/ring.h"
 #include "audio/sample.h"
 #include "audio/stream.h"
 #include "audio/track.h"
 
 #include <SDL2/SDL.h>
 
+#include <atomic>
+#include <mutex>
+#include <thread>
+
 /** \defgroup audio Audio
  *
  * \brief
@@ -40,12 +46,14 @@
  *
  * 1. SDL requests for audio samples by calling the callback function
  *    mentionned on device initialization.
- * 2. The callback function copies data from the current frame into SDL's
- *    supplied buffer, and requests more frames until the buffer is full.
- * 3. Frames are read from libavcodec, which keeps returning frames until the
+ * 2. The callback function copies the samples from the #oshu_audio::buffer
+ *    ring into SDL's supplied buffer, and mixes the sound effects in.
+ * 3. Meanwhile, a decoder thread keeps the ring filled about half a second
+ *    ahead, using #oshu_read_stream, which converts the decoded frames.
+ * 4. Frames are read from libavcodec, which keeps returning frames until the
  *    current page is completely read. Request a new page is the current one is
  *    completely consumed.
- * 4. Packets are read from libavformat, which reads data from the audio file,
+ * 5. Packets are read from libavformat, which reads data from the audio file,
  *    and returns pages until *EOF*. The packets are then passed to libavcodec
  *    for decoding.
  *
@@ -64,6 +72,13 @@
  * every packet. ffmpeg insert a more precise timestamp into every frame called
  * the *best effort timestamp*. This is what we'll use.
  *
+ * Decoding is kept out of the audio callback because its duration is
+ * unpredictable: reading a page may block on I/O, and some frames are much
+ * more expensive to decode than others. If the callback doesn't return in
+ * time, the sound card runs out of samples and crackles. The ring between the
+ * decoder thread and the callback is lock-free, so neither waits for the
+ * other.
+ *
  * Once a frame is decoded, and at the time we know its PTS, its samples are
  * sent into SDL's audio samples buffer, which are relayed to the sound card.
  * The elapsed time between the frame decoding and its actual playback cannot
@@ -101,9 +116,9 @@
  * 	sample1 -> track1 [label="oshu_start_track"]
  * 	sample1 -> track2 [label="oshu_start_track"]
  * 	sample2 -> track3 [label="oshu_start_track"]
- * 	track1 -> "float*" [label="oshu_mix_track"]
- * 	track2 -> "float*" [label="oshu_mix_track"]
- * 	track3 -> "float*" [label="oshu_mix_track"]
+ * 	track1 -> "float*" [label="oshu_mix"]
+ * 	track2 -> "float*" [label="oshu_mix"]
+ * 	track3 -> "float*" [label="oshu_mix"]
  * 	"float*" -> "SDL"
  * }
  * \enddot
@@ -144,14 +159,118 @@
  * \{
  */
 
+/**
+ * How much a sound matters when all the voices are taken.
+ *
+ * A new sound may only steal a voice whose priority isn't higher than its
+ * own.
+ *
+ * \sa oshu_voice
+ */
+enum oshu_voice_priority {
+	/**
+	 * Normal and whistle hit sounds.
+	 */
+	OSHU_NORMAL_PRIORITY,
+	/**
+	 * Finish and clap hit sounds, which are rarer and stand out, so
+	 * cutting them off is much more noticeable.
+	 */
+	OSHU_HIGH_PRIORITY,
+	/**
+	 * Looping samples, which only other loops may steal.
+	 */
+	OSHU_LOOP_PRIORITY,
+};
+
+/**
+ * A track of the voice pool, playing one sound effect.
+ *
+ * \sa oshu_audio::voices
+ */
+struct oshu_voice {
+	struct oshu_track track;
+	enum oshu_voice_priority priority;
+	/**
+	 * For loops, the channel given to #oshu_schedule_loop, which lets
+	 * #oshu_schedule_stop_loop stop the right ones.
+	 */
+	int channel;
+};
+
+/**
+ * A sample waiting to be played at a precise time of the music.
+ *
+ * \sa oshu_schedule_sample
+ */
+struct oshu_scheduled_sample {
+	/**
+	 * The sample to play, or NULL to stop the loops of #channel.
+	 */
+	struct oshu_sample *sample;
+	float volume;
+	/**
+	 * If true, the sample is looped on #channel.
+	 */
+	int loop;
+	int channel;
+	enum oshu_voice_priority priority;
+	/**
+	 * When to start the sample, in seconds of music.
+	 */
+	double time;
+};
+
+/**
+ * What the game thread asks the audio callback to do.
+ *
+ * \sa oshu_audio::commands
+ */
+enum oshu_audio_command_type {
+	/**
+	 * Add #oshu_audio_command::sound to the schedule. Samples to play
+	 * right away are scheduled at -∞.
+	 */
+	OSHU_SCHEDULE_COMMAND,
+	/**
+	 * Stop all the loops, and cancel the loops in the schedule.
+	 */
+	OSHU_STOP_LOOP_COMMAND,
+	/**
+	 * Drop the music in the ring up to #oshu_audio_command::mark, jump to
+	 * #oshu_audio_command::position, and stop all the sound effects.
+	 */
+	OSHU_SEEK_COMMAND,
+};
+
+/**
+ * A message from the game thread to the audio callback.
+ */
+struct oshu_audio_command {
+	enum oshu_audio_command_type type;
+	/**
+	 * For #OSHU_SCHEDULE_COMMAND.
+	 */
+	struct oshu_scheduled_sample sound;
+	/**
+	 * For #OSHU_SEEK_COMMAND, the value of #oshu_ring::write right after
+	 * the stream was seeked. Everything before is the old music.
+	 */
+	size_t mark;
+	/**
+	 * For #OSHU_SEEK_COMMAND, the position of the music at #mark.
+	 */
+	double position;
+};
+
 /**
  * The full audio pipeline.
  *
- * This structure is mainly accessed through an audio thread, and should be
- * locked using SDL's `SDL_LockAudioDevice` and `SDL_UnlockAudioDevice`
- * procedures in order to be accessed peacefully from another thread. You don't
- * need to bother with locking when using the accessors defined in this module
- * though. Only lock when accessing multiple fields directly.
+ * This structure is mainly accessed through an audio thread. The game thread
+ * never locks it: the accessors defined in this module send
+ * #oshu_audio_command messages through the #commands ring instead, which the
+ * audio callback handles before filling each buffer. This way, neither thread
+ * ever waits for the other.
  *
  * \todo
  * Rename this to oshu::audio::engine.
@@ -159,32 +278,144 @@
 struct oshu_audio {
 	/**
 	 * The background music.
+	 *
+	 * Once the audio is open, it belongs to the #decoder thread, and must
+	 * only be accessed with the #decoding mutex held.
+	 *
+	 * Its #oshu_stream::current_timestamp is ahead of what is being played.
+	 * Use #position instead.
 	 */
 	struct oshu_stream music;
 	/**
-	 * Tracks for playing sound effects on top of the music.
+	 * Samples of the music decoded in advance by the #decoder thread, and
+	 * read by the audio callback.
 	 *
-	 * Up to 8 samples may be played at a time.
+	 * Its fill level, given by #oshu_ring_fill, tells how much music is
+	 * buffered.
+	 */
+	struct oshu_ring buffer;
+	/**
+	 * Thread reading the #music stream into the #buffer.
+	 */
+	std::thread decoder;
+	/**
+	 * Held by the #decoder thread while it reads the #music.
+	 */
+	std::mutex decoding;
+	/**
+	 * Tell the #decoder thread to stop.
+	 */
+	std::atomic<bool> stopping;
+	/**
+	 * Set by the #decoder thread when the whole #music was written to the
+	 * #buffer.
+	 */
+	std::atomic<bool> drained;
+	/**
+	 * The position of the music being played, in seconds.
+	 *
+	 * It is updated by the audio callback as it reads samples from the
+	 * #buffer.
+	 */
+	std::atomic<double> position;
+	/**
+	 * How many times the audio callback found the #buffer empty before
+	 * the end of the music.
+	 *
+	 * Every underrun is heard as a short silence.
+	 */
+	std::atomic<int> underruns;
+	/**
+	 * Pool of voices for playing sound effects and loops on top of the
+	 * music.
+	 *
+	 * Its size is read from the OSHU_AUDIO_VOICES environment variable.
+	 * When every voice is taken, a new sound steals the voice with the
+	 * lowest priority and, among them, the least remaining energy, which
+	 * is how loud and long the rest of its sample is. When there's no
+	 * voice of lower or equal priority, the new sound is dropped.
 	 *
-	 * When the need for looping samples arise, it would be smart to
-	 * dedicate a track for them.
+	 * It belongs to the audio callback.
 	 *
 	 * \sa oshu_play_sample
 	 */
-	struct oshu_track effects[16];
+	struct oshu_voice *voices;
+	int voice_count;
+	/**
+	 * Buffer for the inputs the audio callback gathers from the #voices.
+	 */
+	struct oshu_mix_input *mix_inputs;
+	int max_mix_inputs;
+	/**
+	 * Number of voices playing during the last audio callback.
+	 */
+	std::atomic<int> active_voices;
+	/**
+	 * The highest #active_voices since the audio was opened.
+	 */
+	std::atomic<int> peak_voices;
 	/**
-	 * Special track for the looping sample.
+	 * How many sounds were cut off by a new sound.
+	 */
+	std::atomic<int> stolen_voices;
+	/**
+	 * How many sounds couldn't find a voice at all.
+	 */
+	std::atomic<int> dropped_voices;
+	/**
+	 * Samples waiting to be started by the audio callback, sorted by time.
 	 *
-	 * As you can see, only one loop is supported.
+	 * It belongs to the audio callback, and is filled from the
+	 * #OSHU_SCHEDULE_COMMAND messages.
 	 *
-	 * \sa oshu_play_loop
+	 * \sa oshu_schedule_sample
 	 */
-	struct oshu_track looping;
+	struct oshu_scheduled_sample schedule[256];
+	/**
+	 * Number of samples in the #schedule.
+	 */
+	int scheduled;
+	/**
+	 * Single-producer single-consumer ring of commands, written by the
+	 * game thread and read by the audio callback.
+	 *
+	 * The indices grow forever and are wrapped on access. When the ring is
+	 * full, the command is dropped rather than waiting.
+	 */
+	struct oshu_audio_command commands[1024];
+	/**
+	 * Number of commands ever written to #commands.
+	 */
+	std::atomic<unsigned> commands_written;
+	/**
+	 * Number of commands ever handled by the audio callback.
+	 */
+	std::atomic<unsigned> commands_read;
 	/**
 	 * A device ID returned by SDL, and required by most SDL audio
 	 * functions.
 	 */
 	SDL_AudioDeviceID device_id;
+	/**
+	 * The size of the device buffer we ask SDL for, in samples per
+	 * channel.
+	 *
+	 * It starts with the value of the OSHU_AUDIO_BUFFER environment
+	 * variable, and may be raised by #oshu_check_audio.
+	 */
+	int buffer_size;
+	/**
+	 * When the audio callback was last called, as given by
+	 * `SDL_GetPerformanceCounter`, or 0 after the device was paused.
+	 */
+	std::atomic<Uint64> last_callback;
+	/**
+	 * How many times the audio callback was called late since the device
+	 * was opened, meaning the sound card most likely ran out of samples.
+	 *
+	 * \sa oshu_check_audio
+	 */
+	std::atomic<int> late_callbacks;
 	/**
 	 * Contains the sample rate, format, and channel layout of the audio
 	 * output device.
@@ -216,6 +447,20 @@ int oshu_open_audio(const char *url, struct oshu_audio *audio);
  */
 void oshu_play_audio(struct oshu_audio *audio);
 
+/**
+ * Make sure the audio device keeps up, and raise its buffer size otherwise.
+ *
+ * A small device buffer reduces the latency of the sound effects, but when the
+ * system can't call the audio callback in time, the sound crackles. This
+ * function reopens the device with a buffer twice as big when too many late
+ * callbacks were detected, until it reaches the default size.
+ *
+ * Call it regularly from the main thread, like once per frame.
+ *
+ * \sa oshu_audio::late_callbacks
+ */
+void oshu_check_audio(struct oshu_audio *audio);
+
 /**
  * Pause the stream.
  *
@@ -229,21 +474,55 @@ void oshu_pause_audio(struct oshu_audio *audio);
  *
  * Multiple samples may be played at once, but there's still a limit to the
  * number of samples that can be played simultaneously. When that number is
- * reached because all the effects tracks are used, the playback of one of
- * the samples is stopped to play the new sample.
+ * reached because all the voices are used, the playback of one of the samples
+ * is stopped to play the new sample, if its *priority* allows it.
+ *
+ * \sa oshu_audio::voices
+ */
+void oshu_play_sample(struct oshu_audio *audio, struct oshu_sample *sample, float volume, enum oshu_voice_priority priority);
+
+/**
+ * Play a sample when the music reaches *time*, in seconds.
+ *
+ * The audio callback starts the sample at the exact sample of the buffer that
+ * corresponds to *time*, rather than at the beginning of the next buffer like
+ * #oshu_play_sample does. To be exact, a sample must be scheduled before the
+ * callback mixes the buffer containing *time*, which means at least one device
+ * buffer ahead. Samples scheduled too late are played as soon as possible.
+ *
+ * The schedule is cleared when seeking.
  */
-void oshu_play_sample(struct oshu_audio *audio, struct oshu_sample *sample, float volume);
+void oshu_schedule_sample(struct oshu_audio *audio, struct oshu_sample *sample, float volume, enum oshu_voice_priority priority, double time);
 
 /**
- * Play a looping sample.
+ * Start looping a sample on *channel* when the music reaches *time*.
+ *
+ * Channels are arbitrary numbers. Several loops may play on the same
+ * channel, and stop together.
  *
- * Currently, only one looping sample may be played at a time. Calling this
- * function cancels any other looping sample.
+ * \sa oshu_schedule_sample
+ * \sa oshu_play_loop
+ */
+void oshu_schedule_loop(struct oshu_audio *audio, struct oshu_sample *sample, float volume, int channel, double time);
+
+/**
+ * Stop the loops of *channel* when the music reaches *time*.
+ *
+ * The loops stop at the beginning of the buffer containing *time*.
+ *
+ * \sa oshu_schedule_sample
+ * \sa oshu_stop_loop
+ */
+void oshu_schedule_stop_loop(struct oshu_audio *audio, int channel, double time);
+
+/**
+ * Play a looping sample on *channel*, until it is stopped.
  *
  * \sa oshu_play_sample
+ * \sa oshu_schedule_loop
  * \sa oshu_stop_loop
  */
-void oshu_play_loop(struct oshu_audio *audio, struct oshu_sample *sample, float volume);
+void oshu_play_loop(struct oshu_audio *audio, struct oshu_sample *sample, float volume, int channel);
 
 /**
  * Seek the music stream to the specifed target position in seconds.
@@ -251,17 +530,19 @@ void oshu_play_loop(struct oshu_audio *audio, struct oshu_sample *sample, float
  * See #oshu_seek_stream for details.
  *
  * It is similar to #oshu_seek_stream, with the different that this function
- * locks the audio thread, and stops all the currently playing sound effects,
- * which is definitely what you want.
+ * stops all the currently playing sound effects, which is definitely what you
+ * want. It also drops the music decoded in advance, and updates
+ * #oshu_audio::position right away.
+ *
+ * Only the decoder thread is briefly blocked. The audio callback finishes the
+ * job when it handles the #OSHU_SEEK_COMMAND message.
  */
 int oshu_seek_music(struct oshu_audio *audio, double target);
 
 /**
- * Stop the looping sample.
+ * Stop all the looping samples, whatever their channel.
  *
- * Since only one sample may be played at a time, it's not ambiguous. In the
- * future, if more looping samples are supported, this function's prototype
- * would change.
+ * The loops waiting in the schedule are cancelled too.
  *
  * \sa oshu_play_loop
  */
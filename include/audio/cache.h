@@ -0,0 +1,62 @@
+/**
+ * \file audio/cache.h
+ * \ingroup audio_cache
+ */
+
+#pragma once
+
+struct oshu_sample;
+
+struct SDL_AudioSpec;
+
+/**
+ * \defgroup audio_cache Cache
+ * \ingroup audio
+ *
+ * \brief
+ * Share the loaded samples across the whole process.
+ *
+ * Loading a sample means decoding a WAV file and resampling it for the audio
+ * device, which is too slow to do all over again every time a beatmap is
+ * played. Most samples come from the skin anyway, and are the same for every
+ * beatmap.
+ *
+ * The cache maps a file, identified by its resolved path, and the format of
+ * the device to a single #oshu_sample, shared by everyone who acquires it. The
+ * samples are reference-counted. When a sample is released for the last time,
+ * it is kept around in case another beatmap needs it, until the memory held by
+ * unused samples exceeds a budget, at which point the least recently used ones
+ * are freed.
+ *
+ * When the file changes on disk, it is loaded again, and the samples still
+ * using the old version are freed when released.
+ *
+ * Every function of this module is thread-safe. Two threads acquiring the same
+ * sample at once load it only once: the second waits for the first to finish.
+ *
+ * \{
+ */
+
+/**
+ * Get the sample for the WAV file at *path*, converted to *spec*, loading it
+ * if it isn't in the cache yet.
+ *
+ * When the file can't be loaded, an empty sample is returned nonetheless,
+ * which the tracks skip, and which is released like any other. That way,
+ * broken files aren't retried every time.
+ *
+ * \return NULL only when the file doesn't exist.
+ *
+ * \sa oshu_load_sample
+ * \sa oshu_release_sample
+ */
+struct oshu_sample* oshu_acquire_sample(const char *path, struct SDL_AudioSpec *spec);
+
+/**
+ * Give back a sample returned by #oshu_acquire_sample.
+ *
+ * The sample must not be used after that, since it may be freed.
+ */
+void oshu_release_sample(struct oshu_sample *sample);
+
+/** \} */
@@ -6,8 +6,17 @@
 #pragma once
 
 #include "beatmap/beatmap.h"
+#include "core/thread_pool.h"
 
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 struct oshu_audio;
 struct oshu_sample;
@@ -128,6 +137,18 @@ struct oshu_sound_room {
 	int capacity;
 };
 
+/**
+ * A sample loaded in the background, waiting to be put on its shelf.
+ *
+ * \sa oshu_sound_library::loaded
+ */
+struct oshu_loaded_sample {
+	enum oshu_sample_set_family set;
+	int index;
+	int type;
+	struct oshu_sample *sample;
+};
+
 /**
  * The sound sample library.
  *
@@ -158,6 +179,46 @@ struct oshu_sound_library {
 	struct oshu_sound_room normal;
 	struct oshu_sound_room soft;
 	struct oshu_sound_room drum;
+	/**
+	 * Names of the files in the beatmap directory, listed once by
+	 * #oshu_populate_library rather than probing every possible sample
+	 * file.
+	 *
+	 * Until #beatmap_listed is set, the files are probed one by one.
+	 */
+	std::unordered_set<std::string> beatmap_files;
+	bool beatmap_listed;
+	/**
+	 * Workers loading the samples of the beatmap in the background.
+	 *
+	 * Only the workers touch #loaded. The shelves belong to the game
+	 * thread, which moves the samples from #loaded to their shelf when it
+	 * looks for a sample.
+	 */
+	std::unique_ptr<oshu::thread_pool> loader;
+	std::mutex loading;
+	std::vector<struct oshu_loaded_sample> loaded;
+	/**
+	 * Number of samples submitted to the #loader and not put on their
+	 * shelf yet.
+	 */
+	std::atomic<int> pending;
+	/**
+	 * Set when the library is closed, for the #loader to skip the samples
+	 * it hasn't started loading yet.
+	 */
+	std::atomic<bool> cancelled;
+	/**
+	 * The sample to play for every set, index and type combination looked
+	 * up so far, with the fallback on the default shelf already applied.
+	 *
+	 * Hit sounds use a handful of combinations over and over, so looking
+	 * a sample up is a single hash lookup, instead of a scan of the room
+	 * for the index, and then for the default shelf.
+	 *
+	 * Entries are forgotten when a shelf they depend on gets a new sample.
+	 */
+	std::unordered_map<uint64_t, struct oshu_sample*> resolved;
 };
 
 /**
@@ -174,7 +235,10 @@ struct oshu_sound_library {
 void oshu_open_sound_library(struct oshu_sound_library *library, struct SDL_AudioSpec *format);
 
 /**
- * Delete all the loaded samples from the library.
+ * Release all the samples of the library.
+ *
+ * The samples stay in the \ref audio_cache for a while, so that the next
+ * library doesn't need to load them again.
  */
 void oshu_close_sound_library(struct oshu_sound_library *library);
 
@@ -198,6 +262,11 @@ void oshu_register_sound(struct oshu_sound_library *library, struct oshu_hit_sou
 /**
  * Find every sample reference into a beatmap and load them into the library.
  *
+ * The default shelves, which every beatmap falls back on, are loaded right
+ * away. The samples specific to the beatmap are loaded in the background by
+ * the #oshu_sound_library::loader, starting with the ones the beatmap needs
+ * first. Until a sample is loaded, the default one is played instead.
+ *
  * \sa oshu_register_sounds
  */
 void oshu_populate_library(struct oshu_sound_library *library, struct oshu_beatmap *beatmap);
@@ -207,10 +276,26 @@ void oshu_populate_library(struct oshu_sound_library *library, struct oshu_beatm
  *
  * If one of the required samples wasn't found, it is ignored.
  *
- * If the sound is for a slider, its sample is looped until you call #oshu_stop_loop.
+ * Finishes and claps are played with a higher priority than the other
+ * additions, so that they are the last to be cut off when the voices run out.
+ *
+ * If the sound is for a slider, its sample is looped on channel 0 until you
+ * call #oshu_stop_loop.
  *
  * \sa oshu_find_sample
  */
 void oshu_play_sound(struct oshu_sound_library *library, struct oshu_hit_sound *sound, struct oshu_audio *audio);
 
+/**
+ * Play all the samples associated to the hit sound when the music reaches
+ * *time*, in seconds.
+ *
+ * This is the sample-accurate version of #oshu_play_sound, for sounds whose
+ * time is known in advance. Slider sounds are looped on *channel*.
+ *
+ * \sa oshu_schedule_sample
+ * \sa oshu_schedule_loop
+ */
+void oshu_schedule_sound(struct oshu_sound_library *library, struct oshu_hit_sound *sound, struct oshu_audio *audio, int channel, double time);
+
 /** \} */
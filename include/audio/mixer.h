@@ -0,0 +1,66 @@
+/**
+ * \file audio/mixer.h
+ * \ingroup audio_mixer
+ */
+
+#pragma once
+
+/**
+ * \defgroup audio_mixer Mixer
+ * \ingroup audio
+ *
+ * \brief
+ * Add sound effects on top of the music, fast.
+ *
+ * Mixing runs in the audio callback, whose time is tight, especially with
+ * small buffers. Rather than making one pass over the output buffer for every
+ * track, and then another one to clip the result, the mixer splits the buffer
+ * into blocks that fit in the L1 cache, adds every input that overlaps a block,
+ * and clips the block right away.
+ *
+ * The inner loops are vectorized with SSE2 or AVX2, depending on what the CPU
+ * supports, which is detected once at startup. Other architectures use a
+ * plain C loop.
+ *
+ * \{
+ */
+
+/**
+ * A range of samples to add to the output buffer.
+ *
+ * Like everything else, the samples are packed stereo floats.
+ *
+ * \sa oshu_gather_track
+ */
+struct oshu_mix_input {
+	/**
+	 * The first sample to mix.
+	 */
+	const float *samples;
+	/**
+	 * Where the first sample goes in the output buffer, in samples per
+	 * channel.
+	 */
+	int offset;
+	/**
+	 * How many samples per channel to mix.
+	 */
+	int length;
+	/**
+	 * The factor to apply to the samples, from 0 to 1.
+	 */
+	float volume;
+};
+
+/**
+ * Add the *inputs* on top of the *samples* buffer, and clip the result so that
+ * every sample is between -1 and 1.
+ *
+ * Without clipping, some audio cards emit an awful noise.
+ *
+ * The *samples* buffer contains 2 × *nb_samples* floats. Every input must fit
+ * inside it.
+ */
+void oshu_mix(float *samples, int nb_samples, const struct oshu_mix_input *inputs, int count);
+
+/** \} */
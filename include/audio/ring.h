@@ -0,0 +1,100 @@
+/**
+ * \file audio/ring.h
+ * \ingroup audio_ring
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+
+/**
+ * \defgroup audio_ring Ring
+ * \ingroup audio
+ *
+ * \brief
+ * Pass audio samples from one thread to another without locking.
+ *
+ * The ring is a circular buffer of packed stereo float samples with exactly
+ * one writer thread and one reader thread. Neither side ever blocks: the
+ * writer writes as much as there is space left, and the reader reads as much
+ * as there are samples available.
+ *
+ * This is what lets the audio callback stay away from the decoder, whose
+ * latency is unpredictable.
+ *
+ * The positions of both ends are counted in samples per channel since the
+ * creation of the ring, and only ever increase. Their difference is the number
+ * of samples waiting in the ring.
+ *
+ * \{
+ */
+
+struct oshu_ring {
+	/**
+	 * The circular buffer, containing 2 × #capacity floats.
+	 */
+	float *samples;
+	/**
+	 * The size of the ring in samples per channel.
+	 *
+	 * It's always a power of 2, so that positions are turned into offsets
+	 * with a mask.
+	 */
+	size_t capacity;
+	/**
+	 * Total number of samples read. Only the reader modifies it.
+	 */
+	std::atomic<size_t> read;
+	/**
+	 * Total number of samples written. Only the writer modifies it.
+	 */
+	std::atomic<size_t> write;
+};
+
+/**
+ * Allocate a ring that can hold at least *capacity* samples per channel.
+ *
+ * \return 0 on success, -1 on failure.
+ */
+int oshu_create_ring(struct oshu_ring *ring, size_t capacity);
+
+/**
+ * Free the ring buffer.
+ */
+void oshu_destroy_ring(struct oshu_ring *ring);
+
+/**
+ * Number of samples per channel ready to be read.
+ */
+size_t oshu_ring_fill(struct oshu_ring *ring);
+
+/**
+ * Copy up to *nb_samples* samples per channel into the ring.
+ *
+ * Only call it from the writer thread.
+ *
+ * \return The number of samples per channel written, limited by the space
+ *         left in the ring.
+ */
+size_t oshu_write_ring(struct oshu_ring *ring, const float *samples, size_t nb_samples);
+
+/**
+ * Copy up to *nb_samples* samples per channel out of the ring.
+ *
+ * Only call it from the reader thread.
+ *
+ * \return The number of samples per channel read, limited by the samples
+ *         available.
+ */
+size_t oshu_read_ring(struct oshu_ring *ring, float *samples, size_t nb_samples);
+
+/**
+ * Drop everything written before *mark*, a value of #oshu_ring::write read
+ * earlier.
+ *
+ * Only the reader may call it. What was written after *mark* is kept.
+ */
+void oshu_skip_ring(struct oshu_ring *ring, size_t mark);
+
+/** \} */
@@ -38,6 +38,10 @@
  * }
  * \enddot
  *
+ * A stream may also be decoded entirely in memory with #oshu_preload_stream.
+ * It takes a second or two when opening the stream, and about 10 MB per minute
+ * of music, but reading it becomes a mere copy, and seeking becomes exact.
+ *
  * \{
  */
 
@@ -147,6 +151,28 @@ struct oshu_stream {
 	 * samples per channel in the frame, we must request a new frame.
 	 */
 	int sample_index;
+	/**
+	 * The whole stream decoded in memory, as packed stereo float samples,
+	 * or NULL when the stream is decoded progressively.
+	 *
+	 * \sa oshu_preload_stream
+	 */
+	float *pcm;
+	/**
+	 * The number of samples per channel in #pcm.
+	 */
+	int pcm_samples;
+	/**
+	 * The position of the next sample to read from #pcm, in samples per
+	 * channel.
+	 */
+	int pcm_cursor;
+	/**
+	 * The timestamp of the first sample of #pcm.
+	 *
+	 * It's usually 0, but some formats start a few milliseconds later.
+	 */
+	double pcm_start;
 	/**
 	 * True when the end of the stream is reached.
 	 *
@@ -166,6 +192,18 @@ struct oshu_stream {
  */
 int oshu_open_stream(const char *url, struct oshu_stream *stream);
 
+/**
+ * Decode the rest of the stream in memory, into #oshu_stream::pcm.
+ *
+ * Call it right after #oshu_open_stream. Then, #oshu_read_stream and
+ * #oshu_seek_stream work on the in-memory samples, without touching ffmpeg
+ * anymore.
+ *
+ * \return 0 on success, -1 on failure. When it fails, the stream is sought
+ *         back to where it was, and keeps being decoded progressively.
+ */
+int oshu_preload_stream(struct oshu_stream *stream);
+
 /**
  * Read *nb_samples* float samples from an audio stream.
  *
@@ -193,10 +231,14 @@ int oshu_read_stream(struct oshu_stream *stream, float *samples, int nb_samples)
  * To determine the new position of the stream after seeking, use
  * #oshu_stream::current_timestamp.
  *
+ * When the stream is preloaded, the new position is exactly the target.
+ * Otherwise, it depends on the keyframes of the container.
+ *
  * You should probably use #oshu_seek_music instead.
  *
  * \todo
- * There's often some kind of audio distortion glitch right after seeking.
+ * There's often some kind of audio distortion glitch right after seeking,
+ * unless the stream is preloaded.
  *
  */
 int oshu_seek_stream(struct oshu_stream *stream, double target);
@@ -5,6 +5,7 @@
 
 #pragma once
 
+struct oshu_mix_input;
 struct oshu_sample;
 
 /**
@@ -58,6 +59,13 @@ struct oshu_track {
 	 * #oshu_stop_track is called.
 	 */
 	int loop;
+	/**
+	 * Number of samples per channel of silence before the sample starts.
+	 *
+	 * It lets a sample start in the middle of a buffer. It is reset to 0
+	 * by #oshu_start_track.
+	 */
+	int delay;
 };
 
 /**
@@ -80,23 +88,21 @@ void oshu_start_track(struct oshu_track *track, struct oshu_sample *sample, floa
 void oshu_stop_track(struct oshu_track *track);
 
 /**
- * Mix a track on top of an audio stream.
- *
- * The track may be active or not.
+ * Advance a track by *nb_samples* samples per channel, and describe what it
+ * plays during that time as inputs for #oshu_mix.
  *
- * The *samples* buffer must contain at least 2 × *nb_samples* floats, already
- * filled with audio data. The samples of the track are added on top of it.
+ * The track may be active or not. A looping track may need several inputs
+ * when it wraps around, which is why up to *max_inputs* inputs are written
+ * into *inputs*. If that's not enough, the part of the sample that would
+ * have needed more inputs is skipped, and the track still advances by
+ * *nb_samples*.
  *
- * The operation performed for mixing the samples is called multiply-accumulate
- * (MAC) and when dealing with audio, there are specialized hardware units to
- * handle it. The *fmaf* function in math.h should be able to perform the
- * operation in a single step, with less rounding error.
+ * The inputs point to the track's sample, and remain valid as long as the
+ * sample is alive.
  *
  * \return
- * The number of samples per channel that were added to the buffer. It may be 0
- * when the stream is inactive, or less than *nb_samples* when the sample has
- * reached an end.
+ * The number of inputs written. It is 0 when the track is inactive.
  */
-int oshu_mix_track(struct oshu_track *track, float *samples, int nb_samples);
+int oshu_gather_track(struct oshu_track *track, int nb_samples, struct oshu_mix_input *inputs, int max_inputs);
 
 /** \} */
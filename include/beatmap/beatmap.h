@@ -6,6 +6,7 @@
 #pragma once
 
 #include "beatmap/path.h"
+#include "core/arena.h"
 
 struct oshu_texture;
 
@@ -543,6 +544,13 @@ struct oshu_hit {
 	 * The GUI module should manage its own texture cache.
 	 */
 	struct oshu_texture *texture;
+	/**
+	 * Position of the hit in the #oshu_hit_table of its beatmap.
+	 *
+	 * The first unreachable hit has index 0, and the last one has index
+	 * #oshu_hit_table::size - 1.
+	 */
+	int index;
 	/**
 	 * Pointer to the previous element of the linked list.
 	 *
@@ -574,6 +582,77 @@ double oshu_hit_end_time(struct oshu_hit *hit);
  */
 oshu_point oshu_end_point(struct oshu_hit *hit);
 
+/**
+ * Packed copy of the hot properties of every hit object.
+ *
+ * Walking the linked list of #oshu_hit means jumping from one fat node to
+ * another, which is bad for the cache when we only want to compare times or
+ * positions. The parser therefore builds, next to the list, one dense array
+ * per property, all indexed like #oshu_hit::index.
+ *
+ * Entry *i* of every array describes the same hit, whose node is `hits[i]`.
+ * The unreachable hits enclosing the list are included, so the first entry's
+ * time is *-INFINITY* and the last one's is *+INFINITY*.
+ *
+ * The arrays are allocated from the #oshu_beatmap::arena.
+ *
+ * Every property but #state is immutable. To change the state of a hit, use
+ * #oshu_set_hit_state to keep the node and the table in sync.
+ */
+struct oshu_hit_table {
+	/**
+	 * Number of entries in every array, including the two unreachable
+	 * hits.
+	 */
+	int size;
+	/**
+	 * Copy of #oshu_hit::time, in chronological order.
+	 */
+	double *time;
+	/**
+	 * Result of #oshu_hit_end_time.
+	 *
+	 * Unlike #time, it is not sorted, because long hits may overlap.
+	 *
+	 * \sa max_end_time
+	 */
+	double *end_time;
+	/**
+	 * Running maximum of #end_time: entry *i* is the latest end time among
+	 * the hits 0 to *i*.
+	 *
+	 * Unlike #end_time, it is sorted, which makes it possible to binary
+	 * search the first hit that ends after a given time, overlapping
+	 * sliders included.
+	 */
+	double *max_end_time;
+	/**
+	 * Horizontal coordinate of #oshu_hit::p.
+	 */
+	float *x;
+	/**
+	 * Vertical coordinate of #oshu_hit::p.
+	 */
+	float *y;
+	/**
+	 * Copy of #oshu_hit::type.
+	 */
+	int *type;
+	/**
+	 * Copy of #oshu_hit::state.
+	 */
+	enum oshu_hit_state *state;
+	/**
+	 * The nodes themselves.
+	 */
+	struct oshu_hit **hits;
+};
+
+/**
+ * Change the #oshu_hit::state of a hit, and its copy in the table.
+ */
+void oshu_set_hit_state(struct oshu_hit_table *table, struct oshu_hit *hit, enum oshu_hit_state state);
+
 /**
  * \brief Complete definition of the [Metadata] section.
  *
@@ -581,7 +660,9 @@ oshu_point oshu_end_point(struct oshu_hit *hit);
  * a dynamically allocated string.
  *
  * This structure should *own* the strings it references, so make sure you
- * `strdup` your strings before filling it.
+ * `strdup` your strings before filling it. The exception is beatmaps loaded
+ * with #oshu_map_beatmap, whose strings all point inside the
+ * #oshu_beatmap::mapping.
  *
  * All the strings are encoded in UTF-8.
  */
@@ -906,8 +987,41 @@ struct oshu_beatmap {
 	 * the first object, and *+INFINITY* for the last one; and also the
 	 * *next* and *previous* pointers. This lets you ensure your hit cursor
 	 * is never null.
+	 *
+	 * \sa table
 	 */
 	struct oshu_hit *hits;
+	/**
+	 * Dense view of the #hits, for fast searches.
+	 */
+	struct oshu_hit_table table;
+	/**
+	 * \brief In-memory copy of the beatmap file.
+	 *
+	 * It is only set for beatmaps loaded with #oshu_map_beatmap, in which
+	 * case the strings of the beatmap, like #audio_filename or the
+	 * #metadata, point inside it rather than being allocated one by one.
+	 *
+	 * The mapping is private, and has one extra byte past the end of the
+	 * file to null-terminate the last line.
+	 *
+	 * It is unmapped by #oshu_destroy_beatmap.
+	 */
+	char *mapping;
+	/**
+	 * Size of the #mapping in bytes, including its extra null byte.
+	 */
+	size_t mapping_size;
+	/**
+	 * \brief Memory of the hits, timing points and colors.
+	 *
+	 * All the objects of the lists above, along with their slider paths and
+	 * sounds, are allocated from this arena while parsing, and released
+	 * together by #oshu_destroy_beatmap.
+	 *
+	 * Don't free them individually.
+	 */
+	struct oshu_arena arena;
 };
 
 /**
@@ -939,6 +1053,110 @@ int oshu_load_beatmap(const char *path, struct oshu_beatmap *beatmap);
  */
 int oshu_load_beatmap_headers(const char *path, struct oshu_beatmap *beatmap);
 
+/**
+ * Load a beatmap like #oshu_load_beatmap, but map the whole file in memory
+ * instead of reading it line by line.
+ *
+ * The lines are tokenized in place, and the strings of the beatmap point
+ * directly inside the mapping instead of being duplicated, which saves a lot
+ * of small allocations when scanning many beatmaps.
+ *
+ * The mapping is kept in #oshu_beatmap::mapping until #oshu_destroy_beatmap
+ * is called.
+ */
+int oshu_map_beatmap(const char *path, struct oshu_beatmap *beatmap);
+
+/**
+ * Summary of a beatmap, as returned by #oshu_scan_beatmap.
+ *
+ * Unlike #oshu_beatmap, it owns no memory: the strings are stored inline, and
+ * truncated if they don't fit. Missing strings are empty.
+ *
+ * It can be copied, stored in arrays, and freed without any ceremony.
+ */
+struct oshu_beatmap_info {
+	/**
+	 * Version of the file format, like #oshu_beatmap::version.
+	 */
+	int version;
+	enum oshu_mode mode;
+	char audio_filename[256];
+	/**
+	 * Same as the fields of #oshu_metadata.
+	 */
+	char title[256];
+	char title_unicode[256];
+	char artist[256];
+	char artist_unicode[256];
+	char creator[256];
+	char difficulty_name[256]; /**< #oshu_metadata::version. */
+	char source[256];
+	int beatmap_id;
+	int beatmap_set_id;
+	struct oshu_difficulty difficulty;
+};
+
+/**
+ * Read the summary of a beatmap, from the [General], [Metadata] and
+ * [Difficulty] sections.
+ *
+ * This is the cheapest way to inspect a beatmap, meant for scanning a whole
+ * library. The file is read by small chunks, and reading stops as soon as a
+ * section that comes after these three is reached, usually within the first
+ * kilobytes of the file. Nothing is allocated.
+ *
+ * Lines too long for the internal buffer, which could only be the tags in
+ * practice, are skipped.
+ *
+ * Like the other loaders, fail if the audio file name, or the title, artist,
+ * or difficulty name are missing.
+ */
+int oshu_scan_beatmap(const char *path, struct oshu_beatmap_info *info);
+
+/**
+ * Load a beatmap from its compiled cache, skipping both the parsing and the
+ * normalization of the slider paths.
+ *
+ * The cache lives in `$OSHU_HOME/cache`, or `~/.oshu/cache` by default, and is
+ * named after the absolute path of the .osu file. It is only used when the
+ * size and modification time of the .osu file match the ones recorded when the
+ * cache was written.
+ *
+ * The cache file is mapped in #oshu_beatmap::mapping, and the strings, hits,
+ * timing points and colors point inside it.
+ *
+ * Return -1 when there is no valid cache for that beatmap, without logging
+ * anything alarming.
+ *
+ * \sa oshu_save_beatmap_cache
+ */
+int oshu_load_beatmap_cache(const char *path, struct oshu_beatmap *beatmap);
+
+/**
+ * Write the cache of a fully loaded beatmap, for #oshu_load_beatmap_cache.
+ *
+ * The file is first written under a temporary name, then renamed, so that
+ * readers never see a partial cache.
+ */
+int oshu_save_beatmap_cache(const char *path, struct oshu_beatmap *beatmap);
+
+/**
+ * Load a beatmap from the cache if possible, or else parse it with
+ * #oshu_map_beatmap and write its cache for next time.
+ *
+ * Failing to write the cache is not an error.
+ */
+int oshu_load_cached_beatmap(const char *path, struct oshu_beatmap *beatmap);
+
+/**
+ * Fill the #oshu_beatmap::table from the complete list of #oshu_beatmap::hits,
+ * and number the hits accordingly.
+ *
+ * The arrays are allocated from the beatmap's arena. The loaders call it once
+ * the list is complete, including its final unreachable hit.
+ */
+void oshu_build_hit_table(struct oshu_beatmap *beatmap);
+
 /**
  * Free any object dynamically allocated inside the beatmap.
  */
@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include "core/arena.h"
 #include "core/geometry.h"
 
 /**
@@ -243,8 +244,11 @@ struct oshu_path {
  *
  * In most case, this function will shrink the path, because the actual length
  * is greater than the one specified in the beatmap.
+ *
+ * Bézier paths may need to grow, in which case their arrays are reallocated
+ * from *arena*, which must be the one they were allocated from.
  */
-void oshu_normalize_path(struct oshu_path *path, double length);
+void oshu_normalize_path(struct oshu_path *path, double length, struct oshu_arena *arena);
 
 /**
  * Express the path in floating t-coordinates.
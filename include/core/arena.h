@@ -0,0 +1,86 @@
+/**
+ * \file include/core/arena.h
+ * \ingroup core_arena
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * \defgroup core_arena Arena
+ * \ingroup core
+ *
+ * \brief
+ * Bump allocator for objects that die together.
+ *
+ * A beatmap is made of thousands of small objects, like hits and timing
+ * points, that are all created when the beatmap is loaded, and all freed when
+ * it is destroyed. Allocating them one by one with *calloc* wastes time on both
+ * ends, and scatters them all over the heap.
+ *
+ * An arena instead reserves memory in big chunks, and carves the objects out of
+ * them by simply moving a cursor. Individual objects are never freed, and the
+ * whole arena is released at once with #oshu_arena_free.
+ *
+ * Chunks grow geometrically, so that loading a big beatmap only takes a
+ * handful of allocations.
+ *
+ * A zero-initialized arena is a valid empty arena.
+ *
+ * ```c
+ * struct oshu_arena arena {};
+ * struct oshu_hit *hit = (oshu_hit*) oshu_arena_calloc(&arena, 1, sizeof(*hit));
+ * oshu_arena_free(&arena);
+ * ```
+ *
+ * \{
+ */
+
+struct oshu_arena_chunk;
+
+struct oshu_arena {
+	/**
+	 * Chunk new objects are allocated from.
+	 *
+	 * It is linked to the previously allocated chunks, which are full.
+	 */
+	struct oshu_arena_chunk *chunks;
+	/**
+	 * Capacity of the next chunk to allocate, in bytes.
+	 *
+	 * 0 means the default initial size.
+	 */
+	size_t next_size;
+};
+
+/**
+ * Allocate zero-initialized memory for an array of *count* elements of *size*
+ * bytes from the arena.
+ *
+ * The memory is suitably aligned for any type, like *calloc*'s, and lives
+ * until the arena is freed.
+ *
+ * The allocation never fails, unless the system is out of memory, in which
+ * case the program aborts.
+ */
+void* oshu_arena_calloc(struct oshu_arena *arena, size_t count, size_t size);
+
+/**
+ * Grow an array allocated from the arena, like *realloc* would.
+ *
+ * The old memory is not reclaimed, so prefer allocating the right size in the
+ * first place when it's known.
+ *
+ * Unlike *realloc*, the additional bytes are zero-initialized.
+ */
+void* oshu_arena_realloc(struct oshu_arena *arena, void *ptr, size_t old_size, size_t new_size);
+
+/**
+ * Release all the chunks of an arena at once.
+ *
+ * The arena is left empty and can be reused.
+ */
+void oshu_arena_free(struct oshu_arena *arena);
+
+/** \} */
@@ -0,0 +1,44 @@
+/**
+ * \file include/core/number.h
+ * \ingroup core_number
+ */
+
+#pragma once
+
+/**
+ * \defgroup core_number Numbers
+ * \ingroup core
+ *
+ * \brief
+ * Parse numbers quickly, whatever the locale.
+ *
+ * Beatmaps are full of numbers, and the C library's *strtol* and *strtod* are
+ * both slow and locale-dependent: with a French locale, *strtod* would stop at
+ * the dot of `1.5`. The functions in this module always use the C syntax, and
+ * handle the common short decimal numbers without any library call.
+ *
+ * They follow the *strtol* and *strtod* interface: leading spaces are skipped,
+ * and *end* receives the first character after the number, or *str* if no
+ * number could be read.
+ *
+ * \{
+ */
+
+/**
+ * Parse a decimal integer, with an optional sign.
+ *
+ * Values out of range saturate to INT_MIN or INT_MAX.
+ */
+int oshu_strtoi(const char *str, char **end);
+
+/**
+ * Parse a floating-point number, in the syntax of *strtod* with the C locale.
+ *
+ * The result is the closest double to the decimal value, exactly like
+ * *strtod*. Numbers with up to 19 significant digits and a small exponent are
+ * converted directly, and the rare other ones, including hexadecimal,
+ * infinity and NaN, are delegated to *strtod_l*.
+ */
+double oshu_strtod(const char *str, char **end);
+
+/** \} */
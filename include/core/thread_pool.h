@@ -0,0 +1,110 @@
+/**
+ * \file include/core/thread_pool.h
+ * \ingroup core_thread_pool
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace oshu {
+inline namespace core {
+
+/**
+ * \defgroup core_thread_pool Thread pool
+ * \ingroup core
+ *
+ * \brief
+ * Run independent tasks on several threads.
+ *
+ * The pool spawns a fixed number of workers, each with its own queue of
+ * tasks. A worker runs the most recent task of its own queue, and when it's
+ * empty, steals the oldest task of another worker's queue. This lets tasks
+ * submit sub-tasks cheaply from inside the pool while keeping every worker
+ * busy.
+ *
+ * ```cpp
+ * oshu::thread_pool pool {4};
+ * for (auto &path : paths)
+ * 	pool.submit([&]{ parse(path); });
+ * pool.wait();
+ * ```
+ *
+ * \{
+ */
+
+class thread_pool {
+public:
+	/**
+	 * Spawn *workers* threads.
+	 *
+	 * If *workers* is 0 or less, use as many threads as the hardware
+	 * supports.
+	 */
+	explicit thread_pool(int workers);
+	/**
+	 * Wait for the pending tasks, then stop the workers.
+	 */
+	~thread_pool();
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator=(const thread_pool&) = delete;
+	/**
+	 * Queue a task.
+	 *
+	 * When called from a task, the sub-task is queued to the current
+	 * worker. Otherwise, the tasks are distributed to the workers in turn.
+	 */
+	void submit(std::function<void()> task);
+	/**
+	 * Block until every submitted task has completed, including the
+	 * sub-tasks they submitted.
+	 *
+	 * If a task threw an exception, the first one is rethrown here.
+	 */
+	void wait();
+	/**
+	 * Number of worker threads.
+	 */
+	int size() const;
+
+private:
+	struct worker_queue {
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+	void work(int index);
+	bool pop(int index, std::function<void()> &task);
+	std::vector<std::unique_ptr<worker_queue>> queues;
+	std::vector<std::thread> workers;
+	/**
+	 * Protects everything below.
+	 */
+	std::mutex state;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	/**
+	 * Tasks sitting in a queue.
+	 */
+	size_t queued = 0;
+	/**
+	 * Tasks submitted but not completed yet, running ones included.
+	 */
+	size_t pending = 0;
+	/**
+	 * Queue receiving the next task submitted from outside the pool.
+	 */
+	int next_queue = 0;
+	bool stopping = false;
+	std::exception_ptr failure;
+};
+
+/** \} */
+
+}}
@@ -85,11 +85,12 @@ struct oshu_game : public oshu::game::mode {
 /**
  * Find the first hit object after *now - offset*.
  *
- * It bases the search on the #oshu_game::hit_cursor for performance, but its
- * position won't affect the results.
- *
  * For long notes like sliders, the end time is used, not the start time.
  *
+ * It binary searches #oshu_hit_table::max_end_time, so overlapping sliders are
+ * handled and the cost doesn't depend on the distance from the
+ * #oshu_game::hit_cursor.
+ *
  * \sa oshu_look_hit_up
  */
 struct oshu_hit* oshu_look_hit_back(struct oshu_game *game, double offset);
@@ -97,7 +98,8 @@ struct oshu_hit* oshu_look_hit_back(struct oshu_game *game, double offset);
 /**
  * Find the last hit object before *now + offset*.
  *
- * This is analogous to #oshu_look_hit_back.
+ * This is analogous to #oshu_look_hit_back, but searches
+ * #oshu_hit_table::time.
  */
 struct oshu_hit* oshu_look_hit_up(struct oshu_game *game, double offset);
 
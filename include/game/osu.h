@@ -7,6 +7,7 @@
 
 #include "game/game.h"
 
+#include <math.h>
 #include <memory>
 
 /**
@@ -36,6 +37,22 @@ struct osu_game : public oshu_game {
 	 */
 	enum oshu_finger held_key {};
 	std::shared_ptr<oshu::game::mouse> mouse {};
+	/**
+	 * In autoplay mode, the hit sounds of the hits before that time were
+	 * already scheduled.
+	 *
+	 * \sa oshu_schedule_sound
+	 */
+	double autoplay_horizon {-INFINITY};
+	/**
+	 * The loop channel of the last slider scheduled in autoplay mode.
+	 *
+	 * Every slider loops on its own channel, so that the end of a slider
+	 * doesn't stop the loop of the next one when they overlap.
+	 *
+	 * \sa oshu_schedule_loop
+	 */
+	int autoplay_channel {0};
 
 	int check() override;
 	int check_autoplay() override;
@@ -14,6 +14,8 @@
 namespace oshu {
 namespace library {
 
+struct manifest;
+
 /**
  * \defgroup library_beatmaps Beatmaps
  * \ingroup library
@@ -45,14 +47,19 @@ namespace library {
 /**
  * Gather the key information of a beatmap.
  *
- * To save resources, it uses #oshu_load_beatmap_headers.
+ * To save resources, it only scans the headers with #oshu_scan_beatmap.
  *
  * \todo
  * Reuse the beatmap structure?
  */
 struct beatmap_entry {
+	/**
+	 * Create an empty entry, to be filled manually, like when reading
+	 * the #manifest.
+	 */
+	beatmap_entry() = default;
 	explicit beatmap_entry(const std::string &path);
-	oshu_mode mode;
+	oshu_mode mode = OSHU_OSU_MODE;
 	/**
 	 * Difficulty indicator.
 	 *
@@ -60,7 +67,7 @@ struct beatmap_entry {
 	 * compute. More advanced difficulty calculators exist but this would
 	 * multiply the time required to build an index.
 	 */
-	int difficulty;
+	int difficulty = 0;
 	std::string title;
 	std::string artist;
 	std::string version;
@@ -81,6 +88,13 @@ struct beatmap_entry {
  * Print a warning if the BeatmapSetID of beatmaps is inconsistent.
  */
 struct beatmap_set {
+	/**
+	 * Create an empty set, to be filled manually.
+	 */
+	beatmap_set() = default;
+	/**
+	 * Load all the beatmaps of a directory, sequentially.
+	 */
 	explicit beatmap_set(const std::string &path);
 	/**
 	 * List of beatmap entries inside this set, sorted by difficulty.
@@ -94,13 +108,23 @@ struct beatmap_set {
 /**
  * Load all the entries found in the given directory.
  *
+ * The sets and their entries are loaded concurrently by a pool of *jobs*
+ * threads, or as many as the hardware supports if *jobs* is 0. The result
+ * doesn't depend on the number of threads: sets are sorted by directory name,
+ * and entries by difficulty, then file name.
+ *
+ * When a *manifest* is given, the directories and files whose modification
+ * time didn't change since it was written are not read again. The manifest is
+ * then updated to reflect the current state of the library, so that it can be
+ * saved for the next scan.
+ *
  * \warning
  * This function is expensive.
  *
  * \todo
  * Provide an iterator interface, if needed?
  */
-std::vector<beatmap_set> find_beatmap_sets(const std::string &path);
+std::vector<beatmap_set> find_beatmap_sets(const std::string &path, int jobs = 0, manifest *cache = nullptr);
 
 /** } */
 
@@ -0,0 +1,96 @@
+/**
+ * \file include/library/manifest.h
+ * \ingroup library_manifest
+ */
+
+#pragma once
+
+#include "library/beatmaps.h"
+
+#include <map>
+#include <string>
+#include <sys/types.h>
+#include <time.h>
+
+namespace oshu {
+namespace library {
+
+/**
+ * \defgroup library_manifest Manifest
+ * \ingroup library
+ *
+ * \brief
+ * Remember what was found in the library the last time it was scanned.
+ *
+ * Parsing every beatmap of a big library takes a while, even when only the
+ * headers are read. The manifest records the modification time of every set
+ * directory, and the size and modification time of every .osu file, along
+ * with the #beatmap_entry extracted from it. On the next scan, only the
+ * directories and files whose properties changed need to be read again.
+ *
+ * It is stored as a text file, with one tab-separated record per line:
+ *
+ * ```
+ * oshu! manifest 1
+ * D	<mtime>	<path>
+ * F	<size>	<mtime>	<valid>	<mode>	<difficulty>	<path>	<title>	<artist>	<version>
+ * ```
+ *
+ * The time stamps are written as `seconds.nanoseconds`. Every file record
+ * belongs to the last directory record above it. Tabs, new lines and
+ * backslashes inside strings are escaped with a backslash.
+ *
+ * \{
+ */
+
+/**
+ * State of a .osu file when it was last scanned.
+ */
+struct manifest_file {
+	off_t size = 0;
+	struct timespec mtime = {};
+	/**
+	 * False if the beatmap could not be loaded, in which case #entry is
+	 * meaningless. Invalid beatmaps are remembered too, so that they're
+	 * not parsed again, with the same warnings, every time.
+	 */
+	bool valid = false;
+	beatmap_entry entry;
+};
+
+/**
+ * State of a beatmap set directory when it was last scanned.
+ */
+struct manifest_directory {
+	struct timespec mtime = {};
+	/**
+	 * The .osu files of the directory, indexed by path.
+	 */
+	std::map<std::string, manifest_file> files;
+};
+
+struct manifest {
+	/**
+	 * The beatmap set directories, indexed by path.
+	 */
+	std::map<std::string, manifest_directory> directories;
+};
+
+/**
+ * Load a manifest file.
+ *
+ * If the file doesn't exist, or is invalid, return an empty manifest, which
+ * simply means everything will be scanned again.
+ */
+manifest read_manifest(const std::string &path);
+
+/**
+ * Write a manifest file, atomically replacing any previous one.
+ *
+ * Throw an exception on failure.
+ */
+void write_manifest(const manifest &m, const std::string &path);
+
+/** \} */
+
+}}
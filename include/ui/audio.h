@@ -5,8 +5,8 @@
 
 #pragma once
 
+struct oshu_audio;
 struct oshu_display;
-struct oshu_stream;
 
 /**
  * \defgroup ui_audio Audio
@@ -19,7 +19,7 @@ struct oshu_stream;
  */
 
 /**
- * The audio progress bar show what part of a stream is currently playing.
+ * The audio progress bar show what part of the music is currently playing.
  *
  * It appears as a full-width transparent bar that fills as the song is played.
  *
@@ -29,17 +29,20 @@ struct oshu_stream;
  */
 struct oshu_audio_progress_bar {
 	struct oshu_display *display;
-	struct oshu_stream *stream;
+	struct oshu_audio *audio;
 };
 
 /**
- * Create an audio progress bar for an audio stream.
+ * Create an audio progress bar for the music of an audio context.
  *
- * The audio stream must exist at least as long as the widget.
+ * The audio context must exist at least as long as the widget.
  *
- * The stream must have a non-zero duration.
+ * The music must have a non-zero duration.
+ *
+ * The bar follows #oshu_audio::position, which is what's being played, and is
+ * safe to read while the music is decoded on its own thread.
  */
-int oshu_create_audio_progress_bar(struct oshu_display *display, struct oshu_stream *stream, struct oshu_audio_progress_bar *bar);
+int oshu_create_audio_progress_bar(struct oshu_display *display, struct oshu_audio *audio, struct oshu_audio_progress_bar *bar);
 
 /**
  * Display the progress bar at the bottom of the screen.
@@ -5,20 +5,46 @@
 
 #pragma once
 
+#include "core/thread_pool.h"
 #include "game/controls.h"
 #include "ui/cursor.h"
 #include "ui/widget.h"
+#include "video/atlas.h"
+#include "video/batch.h"
+#include "video/paint.h"
 #include "video/texture.h"
 
 #include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
 
 struct osu_game;
+struct oshu_hit;
 
 namespace oshu {
 namespace ui {
 
 struct osu;
 
+/**
+ * A slider body painted in the background, waiting to be uploaded.
+ *
+ * \sa osu::painted
+ */
+struct painted_slider {
+	struct oshu_hit *hit;
+	struct oshu_painter painter;
+	/**
+	 * The anchor of the texture, since the painter doesn't know about it.
+	 */
+	oshu_point origin;
+	/**
+	 * False if the painting failed.
+	 */
+	bool ok;
+};
+
 struct osu_mouse : public oshu::game::mouse {
 	osu_mouse(oshu_display *display);
 	oshu_display *display;
@@ -40,6 +66,18 @@ struct osu : public widget {
 
 	void draw() override;
 
+	/**
+	 * Every texture below, and the sliders, are packed in this atlas.
+	 *
+	 * The sliders may be evicted from it, in which case they are painted
+	 * again when needed.
+	 */
+	struct oshu_atlas atlas {};
+	/**
+	 * Every frame is drawn through this batch, to draw the sprites of the
+	 * same atlas page together.
+	 */
+	struct oshu_sprite_batch batch {};
 	/**
 	 * Dynamic array of circle hit object textures.
 	 *
@@ -95,6 +133,26 @@ struct osu : public widget {
 	 * mouse is a central part of the gameplay.
 	 */
 	struct oshu_cursor_widget cursor {};
+	/**
+	 * Workers painting the sliders a few seconds before they appear.
+	 *
+	 * \sa osu_prepaint_sliders
+	 */
+	std::unique_ptr<oshu::thread_pool> painters;
+	/**
+	 * Sliders submitted to the #painters and not uploaded yet.
+	 *
+	 * Only the render thread uses it.
+	 */
+	std::unordered_set<struct oshu_hit*> painting;
+	/**
+	 * Protects #painted.
+	 */
+	std::mutex painted_lock;
+	/**
+	 * Sliders the #painters are done with, in the order they finished.
+	 */
+	std::vector<painted_slider> painted;
 };
 
 /** \} */
@@ -117,12 +175,28 @@ int osu_paint_resources(oshu::ui::osu&);
  * because painting all the sliders at once would increase the startup time by
  * up to a few long seconds.
  *
- * The texture is stored in `hit->texture`.
+ * The texture is stored in `hit->texture`. Nothing is done if it's already
+ * there, unless the atlas evicted it.
  *
  * Slider textures are freed with #osu_free_resources.
  */
 int osu_paint_slider(oshu::ui::osu&, struct oshu_hit *hit);
 
+/**
+ * Paint the sliders that are about to appear in the background, and upload
+ * the ones that are ready.
+ *
+ * The painting, which is the expensive part, is done by the
+ * oshu::ui::osu::painters a few seconds ahead. Only the upload is done on the
+ * render thread, and only a few milliseconds' worth of them per call, unless
+ * a slider is already visible.
+ *
+ * Call it once per frame, before drawing the hits. A slider that is visible
+ * without having been painted is painted right away by the drawing routine,
+ * like before.
+ */
+void osu_prepaint_sliders(oshu::ui::osu&);
+
 /**
  * Free the dynamic resources of the game mode.
  */
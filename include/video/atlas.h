@@ -0,0 +1,214 @@
+/**
+ * \file video/atlas.h
+ * \ingroup video_atlas
+ */
+
+#pragma once
+
+#include <vector>
+
+struct oshu_display;
+struct oshu_texture;
+struct SDL_Surface;
+struct SDL_Texture;
+
+/**
+ * \defgroup video_atlas Atlas
+ * \ingroup video
+ *
+ * \brief
+ * Pack many small textures into a few big ones.
+ *
+ * Every SDL texture drawn in a row costs a texture switch, and every one of
+ * them has its own allocation on the GPU. The atlas stores many images in a
+ * few big textures called pages, and each #oshu_texture it creates points to
+ * a region of a page.
+ *
+ * The regions are allocated with a shelf packer: a page is split into
+ * horizontal shelves, each as tall as the first image put on it, and images
+ * are placed left to right on the shelf whose height fits them best. When
+ * every image of a shelf is freed, the shelf is emptied and may be reused.
+ *
+ * The number of pages is bounded by a memory budget, read from the
+ * `OSHU_TEXTURE_BUDGET` environment variable, in megabytes. When all the pages
+ * are full, the images that were marked as evictable, have expired, and
+ * haven't been drawn for the longest time are removed from the atlas, and the
+ * #oshu_texture objects that held them are emptied. Their owner is expected to
+ * check for that, and recreate the texture if it needs it again.
+ *
+ * An image that will be needed later, like a slider painted ahead of time,
+ * must not be evicted before it's drawn, or its owner would paint it again
+ * and evict another one in turn. Its owner sets #oshu_atlas_entry::expiry to
+ * protect it until then.
+ *
+ * When an image doesn't fit, because it's bigger than a page or because
+ * nothing can be evicted, it gets its own SDL texture like any other
+ * #oshu_texture, outside the budget. In the latter case, the atlas is marked
+ * as #oshu_atlas::full until a region is freed, so that images that aren't
+ * needed right away can be put off.
+ *
+ * The atlas is bound to a display, and must only be used on the render
+ * thread.
+ *
+ * \{
+ */
+
+/**
+ * Flags for #oshu_pack_surface.
+ */
+enum oshu_atlas_flag {
+	/**
+	 * Let the atlas free the image when it needs room.
+	 */
+	OSHU_EVICTABLE = 1,
+};
+
+/**
+ * A row of images in an #oshu_atlas_page.
+ */
+struct oshu_atlas_shelf {
+	/**
+	 * Top of the shelf, in pixels.
+	 */
+	int y;
+	int height;
+	/**
+	 * Where the next image goes, in pixels from the left.
+	 */
+	int x;
+	/**
+	 * Number of images on the shelf.
+	 */
+	int entries;
+};
+
+/**
+ * One of the big textures of an #oshu_atlas.
+ */
+struct oshu_atlas_page {
+	struct SDL_Texture *texture;
+	std::vector<struct oshu_atlas_shelf> shelves;
+	/**
+	 * Bottom of the last shelf, where the next shelf will be created.
+	 */
+	int top;
+};
+
+/**
+ * A region of a page, held by an #oshu_texture.
+ *
+ * The region includes a transparent border of 1 pixel around the image, so
+ * that the filtering doesn't bleed the neighbors into the image.
+ */
+struct oshu_atlas_entry {
+	struct oshu_atlas *atlas;
+	/**
+	 * Index of the page in #oshu_atlas::pages.
+	 */
+	int page;
+	/**
+	 * Index of the shelf in #oshu_atlas_page::shelves.
+	 */
+	int shelf;
+	/**
+	 * Position and size of the image, without the border.
+	 */
+	int x, y, w, h;
+	int flags;
+	/**
+	 * Value of #oshu_atlas::clock when the image was last drawn.
+	 */
+	unsigned long last_use;
+	/**
+	 * The entry is not evicted until #oshu_atlas::now reaches this time.
+	 *
+	 * It's 0 by default, which lets evictable entries go as soon as they
+	 * stop being drawn.
+	 */
+	double expiry;
+	/**
+	 * The texture pointing to this entry, emptied when the entry is
+	 * evicted.
+	 */
+	struct oshu_texture *owner;
+};
+
+struct oshu_atlas {
+	struct oshu_display *display;
+	/**
+	 * Width and height of the pages, in pixels.
+	 */
+	int page_size;
+	/**
+	 * How many pages fit in the budget.
+	 */
+	int max_pages;
+	std::vector<struct oshu_atlas_page> pages;
+	/**
+	 * All the live entries, in no particular order.
+	 */
+	std::vector<struct oshu_atlas_entry*> entries;
+	/**
+	 * Frame counter, incremented by #oshu_tick_atlas, to find the least
+	 * recently used entries.
+	 */
+	unsigned long clock;
+	/**
+	 * Current time, as given to #oshu_tick_atlas, compared against the
+	 * entries' #oshu_atlas_entry::expiry.
+	 */
+	double now;
+	/**
+	 * Set when an image had to be put outside the atlas because nothing
+	 * could be evicted, and cleared when a region is freed.
+	 */
+	bool full;
+};
+
+/**
+ * Prepare an empty atlas for the display, reading the budget from the
+ * environment.
+ *
+ * No page is allocated until an image is packed.
+ *
+ * \sa oshu_destroy_atlas
+ */
+int oshu_create_atlas(struct oshu_display *display, struct oshu_atlas *atlas);
+
+/**
+ * Free the pages of the atlas.
+ *
+ * The textures still pointing to the atlas are emptied, but it's cleaner to
+ * destroy them first with #oshu_destroy_texture.
+ */
+void oshu_destroy_atlas(struct oshu_atlas *atlas);
+
+/**
+ * Copy an ARGB8888 surface into the atlas, and point *texture* to it.
+ *
+ * The texture's size and origin are left untouched, and the surface may be
+ * freed right after.
+ *
+ * Destroy the texture with #oshu_destroy_texture as usual, which gives back
+ * its region to the atlas.
+ *
+ * *flags* is a combination of #oshu_atlas_flag values.
+ */
+int oshu_pack_surface(struct oshu_atlas *atlas, struct SDL_Surface *surface, int flags, struct oshu_texture *texture);
+
+/**
+ * Start a new frame, at time *now*.
+ *
+ * The images drawn during the current or the previous frame are never
+ * evicted, and neither are the ones whose expiry is after *now*.
+ */
+void oshu_tick_atlas(struct oshu_atlas *atlas, double now);
+
+/**
+ * Give back the region of an entry to its atlas, and delete it.
+ *
+ * This is called by #oshu_destroy_texture.
+ */
+void oshu_free_atlas_entry(struct oshu_atlas_entry *entry);
+
+/** \} */
@@ -0,0 +1,128 @@
+/**
+ * \file video/batch.h
+ * \ingroup video_batch
+ */
+
+#pragma once
+
+#include <vector>
+
+struct oshu_display;
+struct SDL_Texture;
+
+/**
+ * \defgroup video_batch Batch
+ * \ingroup video
+ *
+ * \brief
+ * Draw many sprites in a single draw call.
+ *
+ * Calling `SDL_RenderCopy` for every sprite means one draw call per sprite,
+ * which adds up quickly when a frame is made of dozens of hit objects and
+ * hundreds of connector dots. Since most of these textures live on the same
+ * \ref video_atlas page, they can be drawn together as a single textured mesh,
+ * using `SDL_RenderGeometry`.
+ *
+ * A batch is attached to a display with #oshu_begin_batch. From then on,
+ * #oshu_draw_texture and friends queue the sprites instead of drawing them
+ * right away. The queue is flushed every time the texture changes, so that
+ * the drawing order is preserved, and when the batch ends with
+ * #oshu_end_batch. Drawing anything with SDL directly while a batch is active
+ * would thus appear below the queued sprites, unless #oshu_flush_batch is
+ * called first.
+ *
+ * With SDL older than 2.0.18, or when the renderer doesn't support geometry,
+ * the sprites are drawn one by one with `SDL_RenderCopy`, which looks the
+ * same.
+ *
+ * \{
+ */
+
+/**
+ * A textured rectangle waiting to be drawn.
+ */
+struct oshu_sprite {
+	/**
+	 * Destination rectangle, in physical pixels.
+	 */
+	float x, y, w, h;
+	/**
+	 * Source rectangle in the texture, in pixels.
+	 */
+	int sx, sy, sw, sh;
+	/**
+	 * RGBA modulation, where 255 leaves the texture unchanged.
+	 */
+	unsigned char color[4];
+};
+
+/**
+ * A vertex, in the layout expected by `SDL_RenderGeometryRaw`.
+ */
+struct oshu_vertex {
+	float x, y;
+	unsigned char color[4];
+	float u, v;
+};
+
+struct oshu_sprite_batch {
+	struct oshu_display *display;
+	/**
+	 * Texture of all the #sprites.
+	 */
+	struct SDL_Texture *texture;
+	/**
+	 * Physical size of #texture, to compute the texture coordinates.
+	 */
+	int texture_width, texture_height;
+	std::vector<struct oshu_sprite> sprites;
+	/**
+	 * Scratch buffers for the mesh, kept across flushes to avoid
+	 * reallocating them every frame.
+	 */
+	std::vector<struct oshu_vertex> vertices;
+	std::vector<int> indices;
+	/**
+	 * False when `SDL_RenderGeometry` isn't available, in which case the
+	 * sprites are drawn one by one.
+	 */
+	bool geometry;
+	/**
+	 * Statistics, logged by #oshu_destroy_batch.
+	 */
+	long total_sprites, total_draw_calls, frames;
+};
+
+/**
+ * Attach a batch to the display, until #oshu_end_batch.
+ *
+ * The batch may be zero-initialized the first time, and reused for every
+ * frame afterwards.
+ */
+void oshu_begin_batch(struct oshu_display *display, struct oshu_sprite_batch *batch);
+
+/**
+ * Queue a sprite.
+ *
+ * If *texture* is not the texture of the queued sprites, they are flushed
+ * first.
+ */
+void oshu_batch_sprite(struct oshu_sprite_batch *batch, struct SDL_Texture *texture, const struct oshu_sprite *sprite);
+
+/**
+ * Draw the queued sprites.
+ */
+void oshu_flush_batch(struct oshu_sprite_batch *batch);
+
+/**
+ * Flush the batch, and detach it from the display.
+ */
+void oshu_end_batch(struct oshu_display *display);
+
+/**
+ * Free the buffers of a batch that is not in use, and log how many draw calls
+ * it saved.
+ */
+void oshu_destroy_batch(struct oshu_sprite_batch *batch);
+
+/** \} */
@@ -8,6 +8,7 @@
 #include "core/geometry.h"
 #include "video/view.h"
 
+struct oshu_sprite_batch;
 struct SDL_Renderer;
 struct SDL_Window;
 
@@ -23,6 +24,9 @@ struct SDL_Window;
  * video_texture module. Most textures are currently generated using the
  * cairo vector video library. The \ref video_paint module integrates
  * cairo with SDL2 and the \ref video_texture module.
+ * To save texture switches and memory, textures may be packed together with
+ * the \ref video_atlas module, and drawn together with the \ref video_batch
+ * module.
  *
  * To draw text, you will need pango, and more specifically pangocairo. Pango
  * is not directly integrated with this module, but is relatively easy to use
@@ -230,6 +234,13 @@ struct oshu_display {
 	 * it isn't, then the game runs at 30 FPS.
 	 */
 	double frame_duration;
+	/**
+	 * When non-null, the textures are queued there instead of being drawn
+	 * right away.
+	 *
+	 * \sa oshu_begin_batch
+	 */
+	struct oshu_sprite_batch *batch;
 };
 
 /**
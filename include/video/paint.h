@@ -8,8 +8,10 @@
 #include "core/geometry.h"
 
 #include <cairo/cairo.h>
+#include <stddef.h>
 
 struct SDL_Surface;
+struct oshu_atlas;
 struct oshu_display;
 struct oshu_texture;
 
@@ -30,13 +32,23 @@ struct oshu_texture;
  * upload the texture with #oshu_finish_painting.
  *
  * ```c
- * struct oshu_texture t;
+ * struct oshu_texture t {};
  * struct oshu_painter p;
  * oshu_start_painting(128 + 128 * I, 64 + 64 * I, &p);
  * // call cairo with p->cr
  * oshu_finish_painting(&p, display, &t);
  * ```
  *
+ * Painting big textures takes a while, so it may be done away from the render
+ * thread. #oshu_start_offscreen_painting and #oshu_end_offscreen_painting only
+ * touch memory, and may be called from any thread. The result is uploaded
+ * later on the render thread with #oshu_upload_painting.
+ *
+ * The pixels are painted in buffers recycled from one painting to the next,
+ * and copied straight into the texture with `SDL_UpdateTexture`, either in an
+ * atlas page, or in the texture object's current SDL texture when it has the
+ * right size. That way, repainting a texture allocates nothing.
+ *
  * The \ref video/paint.h header imports cairo.h for convenience.
  *
  * \{
@@ -45,9 +57,18 @@ struct oshu_texture;
 struct oshu_painter {
 	struct oshu_display *display;
 	oshu_size size;
+	/**
+	 * An SDL view of the #scratch buffer, which it doesn't own.
+	 */
 	struct SDL_Surface *destination;
 	cairo_surface_t *surface;
 	cairo_t *cr;
+	/**
+	 * The pixel buffer, borrowed from a pool shared by all the painters,
+	 * and given back when the painter is destroyed.
+	 */
+	void *scratch;
+	size_t scratch_size;
 };
 
 /**
@@ -72,6 +93,50 @@ struct oshu_painter {
  */
 int oshu_start_painting(struct oshu_display *display, oshu_size size, struct oshu_painter *painter);
 
+/**
+ * Like #oshu_start_painting, but for a given *zoom* rather than the display's
+ * current view, so that it doesn't touch the display.
+ *
+ * It is thread-safe, and so is painting with Cairo, as long as each painter
+ * is used by a single thread.
+ *
+ * \sa oshu_end_offscreen_painting
+ */
+int oshu_start_offscreen_painting(double zoom, oshu_size size, struct oshu_painter *painter);
+
+/**
+ * Release the Cairo context, and prepare the painted surface for
+ * #oshu_upload_painting.
+ *
+ * Like #oshu_start_offscreen_painting, it may be called from any thread.
+ */
+void oshu_end_offscreen_painting(struct oshu_painter *painter);
+
+/**
+ * Upload a surface prepared with #oshu_end_offscreen_painting as a texture for
+ * the *display*, and free the painter.
+ *
+ * If *texture* already holds a texture of the same size, not from an atlas,
+ * its pixels are replaced. Otherwise, it is destroyed and a new one is
+ * created. The *texture* object must therefore be zero-initialized the first
+ * time.
+ *
+ * It must be called from the render thread.
+ */
+int oshu_upload_painting(struct oshu_painter *painter, struct oshu_display *display, struct oshu_texture *texture);
+
+/**
+ * Like #oshu_upload_painting, but pack the result in an atlas.
+ *
+ * *flags* are passed to #oshu_pack_surface.
+ */
+int oshu_pack_painting(struct oshu_painter *painter, struct oshu_atlas *atlas, int flags, struct oshu_texture *texture);
+
+/**
+ * Free a painter without uploading it, whatever state it's in.
+ */
+void oshu_discard_painting(struct oshu_painter *painter);
+
 /**
  * Load the drawn texture onto the GPU as a texture, and free everything else.
  *
@@ -0,0 +1,37 @@
+/**
+ * \file video/pixels.h
+ * \ingroup video_pixels
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \defgroup video_pixels Pixels
+ * \ingroup video
+ *
+ * \brief
+ * Convert pixel buffers between Cairo's and SDL's formats.
+ *
+ * These loops don't depend on Cairo or SDL, and work on plain buffers of
+ * 32-bit pixels.
+ *
+ * \{
+ */
+
+/**
+ * Convert *count* pixels from Cairo's premultiplied ARGB32 to SDL's straight
+ * ARGB8888, in place.
+ *
+ * It gives the same result as dividing every color by the alpha, but with a
+ * table of reciprocals instead of divisions, and with SSE4.1 or AVX2 when the
+ * CPU supports it. Colors brighter than their alpha, which Cairo never
+ * produces, are clamped.
+ *
+ * This is called by #oshu_end_offscreen_painting.
+ */
+void oshu_unpremultiply(uint32_t *pixels, size_t count);
+
+/** \} */
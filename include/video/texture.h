@@ -7,6 +7,7 @@
 
 #include "core/geometry.h"
 
+struct oshu_atlas_entry;
 struct oshu_display;
 struct SDL_Texture;
 
@@ -77,8 +78,18 @@ struct oshu_texture {
 	oshu_point origin;
 	/**
 	 * The underlying SDL texture.
+	 *
+	 * For textures packed in an atlas, this is the whole atlas page.
 	 */
 	struct SDL_Texture *texture;
+	/**
+	 * The part of #texture to draw, when the texture was packed with
+	 * #oshu_pack_surface, or NULL to draw it whole.
+	 *
+	 * When the atlas evicts the region, both #texture and #region are
+	 * reset to NULL.
+	 */
+	struct oshu_atlas_entry *region;
 };
 
 /**
@@ -97,6 +108,8 @@ int oshu_load_texture(struct oshu_display *display, const char *filename, struct
  * Note that textures are linked to the renderer they were created for, so make
  * sure you delete the textures before the renderer.
  *
+ * Textures packed in an atlas give their region back to the atlas instead.
+ *
  * It is safe to destroy a texture more than once, or destroy a
  * null-initialized texture object.
  */
@@ -125,4 +138,12 @@ void oshu_draw_texture(struct oshu_display *display, struct oshu_texture *textur
  */
 void oshu_draw_scaled_texture(struct oshu_display *display, struct oshu_texture *texture, oshu_point p, double ratio);
 
+/**
+ * Draw a scaled texture with an *opacity* between 0 and 1.
+ *
+ * Unlike setting the alpha modulation of the SDL texture, it works with
+ * textures sharing the same atlas page, and in a batch.
+ */
+void oshu_draw_faded_texture(struct oshu_display *display, struct oshu_texture *texture, oshu_point p, double ratio, double opacity);
+
 /** \} */
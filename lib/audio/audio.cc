@@ -7,48 +7,273 @@
  */
 
 #include "audio/audio.h"
+#include "audio/mixer.h"
 #include "core/log.h"
 
 #include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Work in stereo. */
+static const int channels = 2;
 
 /**
- * Size of the SDL audio buffer, in samples.
+ * Default size of the SDL audio buffer, in samples.
+ *
+ * The smaller it is, the less lag, but the more likely the sound card runs
+ * out of samples when the system is busy. It can be lowered with the
+ * OSHU_AUDIO_BUFFER environment variable.
  *
- * The smaller it is, the less lag.
+ * It is also the largest size #oshu_check_audio falls back to.
  *
  * It should be a power of 2 according to SDL's doc.
  */
-static const int sample_buffer_size = 2048;
+static const int default_buffer_size = 2048;
+
+/**
+ * Smallest buffer size accepted in OSHU_AUDIO_BUFFER.
+ */
+static const int min_buffer_size = 64;
+
+/**
+ * When a callback comes later than this many buffer periods after the
+ * previous one, the sound card has most likely run out of samples.
+ */
+static const double late_callback = 2.;
+
+/**
+ * How many late callbacks are tolerated before #oshu_check_audio doubles the
+ * buffer size.
+ */
+static const int max_late_callbacks = 4;
+
+/**
+ * How much music the decoder thread decodes ahead of the playback, in
+ * seconds.
+ *
+ * It must be well above the duration of the SDL buffer, so that the decoder
+ * has plenty of time to catch up after a slow frame.
+ */
+static const double decode_ahead = .5;
+
+/**
+ * Number of samples per channel the decoder reads at once.
+ */
+static const int decode_chunk = 1024;
+
+/**
+ * How long the decoder sleeps when the ring is full, in milliseconds.
+ */
+static const int decoder_sleep = 5;
+
+/**
+ * Number of voices in the pool, unless OSHU_AUDIO_VOICES says otherwise.
+ */
+static const int default_voices = 32;
 
 /**
- * Clip a buffer of float audio samples to ensure every sample's value is
- * normalized between -1 and 1.
+ * Largest pool accepted in OSHU_AUDIO_VOICES.
+ */
+static const int max_voices = 256;
+
+/**
+ * How many inputs the audio callback reserves per voice.
+ *
+ * A voice needs one input, unless it loops a sample shorter than the buffer,
+ * in which case it needs one more every time the sample wraps around. Loops
+ * short enough to wrap more often than the spare inputs allow are cut short
+ * for the rest of the buffer, without falling behind.
+ */
+static const int inputs_per_voice = 2;
+
+/**
+ * How much of its sample a voice has left to play, weighted by its volume.
+ *
+ * Loops never end, so their energy is infinite.
+ */
+static double remaining_energy(struct oshu_voice *voice)
+{
+	struct oshu_track *track = &voice->track;
+	if (track->loop)
+		return INFINITY;
+	return (double) track->volume * (track->sample->nb_samples - track->cursor);
+}
+
+/**
+ * Pick a voice for playing a sound of the given *priority*.
+ *
+ * If one voice is inactive, pick it without hesitation. Otherwise, steal the
+ * voice with the lowest priority, and among them, the one with the least
+ * energy left, because cutting it off is the least audible.
  *
- * Without this, some audio cards emit an awful noise.
+ * Only the audio callback may call it, since it owns the voices.
+ *
+ * \return NULL when every voice has a higher priority.
+ */
+static struct oshu_voice *select_voice(struct oshu_audio *audio, enum oshu_voice_priority priority)
+{
+	struct oshu_voice *best = NULL;
+	double best_energy = 0;
+	for (int i = 0; i < audio->voice_count; ++i) {
+		struct oshu_voice *v = &audio->voices[i];
+		if (v->track.sample == NULL)
+			return v;
+		if (v->priority > priority)
+			continue;
+		double energy = remaining_energy(v);
+		if (!best || v->priority < best->priority || (v->priority == best->priority && energy < best_energy)) {
+			best = v;
+			best_energy = energy;
+		}
+	}
+	if (best)
+		++audio->stolen_voices;
+	else
+		++audio->dropped_voices;
+	return best;
+}
+
+/**
+ * Stop the loops playing on *channel*.
  */
-static void clip(float *samples, int nb_samples, int channels)
+static void stop_channel(struct oshu_audio *audio, int channel)
 {
-	for (int i = 0; i < nb_samples * channels; ++i) {
-		if (samples[i] > 1.)
-			samples[i] = 1.;
-		else if (samples[i] < -1.)
-			samples[i] = -1.;
+	for (int i = 0; i < audio->voice_count; ++i) {
+		struct oshu_voice *v = &audio->voices[i];
+		if (v->track.loop && v->channel == channel)
+			oshu_stop_track(&v->track);
 	}
 }
 
 /**
- * Fill SDL's audio buffer, while requesting more frames as needed.
+ * Start the scheduled samples that fall into the next *nb_samples* samples
+ * per channel of the music, starting at *position*.
  *
- * libavcodec organize frames by channel in planar mode (LLLLRRRR), while we'd
- * like them to be interleaved as SDL requires (LRLRLRLR). This makes a
- * intricate nesting of loops. In that order: frame loop, sample loop, channel
- * loop. Makes sense.
+ * Each sample is delayed to start exactly when the music reaches its time.
+ * Samples whose time is already past start at the beginning of the buffer.
+ * Stopping the loop isn't delayed, and happens at the beginning of the buffer.
  *
- * When frames are interleaved, a coarser memcpy does the trick.
+ * The schedule is sorted, so the samples to start are all at its beginning.
+ */
+static void start_scheduled(struct oshu_audio *audio, double position, int nb_samples)
+{
+	int rate = audio->device_spec.freq;
+	double end = position + (double) nb_samples / rate;
+	int count = 0;
+	for (; count < audio->scheduled && audio->schedule[count].time < end; ++count) {
+		struct oshu_scheduled_sample *s = &audio->schedule[count];
+		int delay = s->time > position ? (s->time - position) * rate : 0;
+		if (delay >= nb_samples)
+			delay = nb_samples - 1;
+		if (s->loop && !s->sample) {
+			stop_channel(audio, s->channel);
+			continue;
+		}
+		struct oshu_voice *voice = select_voice(audio, s->priority);
+		if (!voice)
+			continue;
+		oshu_start_track(&voice->track, s->sample, s->volume, s->loop);
+		voice->track.delay = delay;
+		voice->priority = s->priority;
+		voice->channel = s->channel;
+	}
+	audio->scheduled -= count;
+	memmove(audio->schedule, audio->schedule + count, audio->scheduled * sizeof(*audio->schedule));
+}
+
+/**
+ * Insert a sample into the schedule, keeping it sorted.
+ *
+ * Samples scheduled at the same time keep the order they were scheduled in.
+ */
+static void schedule(struct oshu_audio *audio, const struct oshu_scheduled_sample *sound)
+{
+	int capacity = sizeof(audio->schedule) / sizeof(*audio->schedule);
+	if (audio->scheduled >= capacity)
+		return;
+	int i = audio->scheduled;
+	for (; i > 0 && audio->schedule[i - 1].time > sound->time; --i)
+		audio->schedule[i] = audio->schedule[i - 1];
+	audio->schedule[i] = *sound;
+	++audio->scheduled;
+}
+
+/**
+ * Stop all the looping voices, and drop the loops from the schedule, which
+ * would otherwise start later.
+ */
+static void stop_loop(struct oshu_audio *audio)
+{
+	for (int i = 0; i < audio->voice_count; ++i) {
+		if (audio->voices[i].track.loop)
+			oshu_stop_track(&audio->voices[i].track);
+	}
+	int kept = 0;
+	for (int i = 0; i < audio->scheduled; ++i) {
+		if (!audio->schedule[i].loop)
+			audio->schedule[kept++] = audio->schedule[i];
+	}
+	audio->scheduled = kept;
+}
+
+/**
+ * Drop the music read before the seek, move to the new position, and stop
+ * everything else.
+ */
+static void seek(struct oshu_audio *audio, const struct oshu_audio_command *command)
+{
+	oshu_skip_ring(&audio->buffer, command->mark);
+	audio->position = command->position;
+	audio->scheduled = 0;
+	for (int i = 0; i < audio->voice_count; ++i)
+		oshu_stop_track(&audio->voices[i].track);
+}
+
+/**
+ * Handle all the commands the game thread sent since the previous callback.
  *
- * When the stream is finished, fill what remains of the buffer with silence,
+ * \return true if the music was seeked.
+ */
+static bool handle_commands(struct oshu_audio *audio)
+{
+	const unsigned capacity = sizeof(audio->commands) / sizeof(*audio->commands);
+	unsigned read = audio->commands_read.load(std::memory_order_relaxed);
+	unsigned written = audio->commands_written.load(std::memory_order_acquire);
+	bool seeked = false;
+	for (; read != written; ++read) {
+		const struct oshu_audio_command *command = &audio->commands[read % capacity];
+		switch (command->type) {
+		case OSHU_SCHEDULE_COMMAND:
+			schedule(audio, &command->sound);
+			break;
+		case OSHU_STOP_LOOP_COMMAND:
+			stop_loop(audio);
+			break;
+		case OSHU_SEEK_COMMAND:
+			seek(audio, command);
+			seeked = true;
+			break;
+		}
+	}
+	audio->commands_read.store(read, std::memory_order_release);
+	return seeked;
+}
+
+/**
+ * Fill SDL's audio buffer with the music decoded in advance, and mix the
+ * sound effects on top of it.
+ *
+ * When the ring is short, fill what remains of the buffer with silence,
  * because you never know what SDL might do with a left-over buffer. Most
- * likely, it would play the previous buffer over, and over again.
+ * likely, it would play the previous buffer over, and over again. If the
+ * music isn't over, it's an underrun.
+ *
+ * This function must never block, so it doesn't touch the music stream, and
+ * learns what the game wants through the command ring.
+ *
+ * The game thread may set the #oshu_audio::position when seeking while this
+ * function runs, in which case the position computed here is discarded.
  */
 static void audio_callback(void *userdata, Uint8 *buffer, int len)
 {
@@ -59,21 +284,40 @@ static void audio_callback(void *userdata, Uint8 *buffer, int len)
 	int nb_samples = len / unit;
 	float *samples = (float*) buffer;
 
-	int rc = oshu_read_stream(&audio->music, samples, nb_samples);
-	if (rc < 0) {
-		oshu_log_debug("failed reading samples from the audio stream");
-		return;
-	} else if (rc < nb_samples) {
+	Uint64 now = SDL_GetPerformanceCounter();
+	Uint64 last = audio->last_callback.exchange(now);
+	double period = (double) audio->device_spec.samples / audio->device_spec.freq;
+	if (last && (double) (now - last) / SDL_GetPerformanceFrequency() > late_callback * period)
+		++audio->late_callbacks;
+
+	bool seeked = handle_commands(audio);
+	double position = audio->position;
+	bool drained = audio->drained;
+	size_t rc = oshu_read_ring(&audio->buffer, samples, nb_samples);
+	if (rc < (size_t) nb_samples) {
 		/* fill what remains with silence */
 		memset(buffer + rc * unit, 0, len - rc * unit);
+		/* right after a seek, the decoder may not have caught up yet */
+		if (!drained && !seeked)
+			++audio->underruns;
 	}
+	double expected = position;
+	audio->position.compare_exchange_strong(expected, position + (double) rc / audio->device_spec.freq);
+	start_scheduled(audio, position, nb_samples);
 
-	int tracks = sizeof(audio->effects) / sizeof(*audio->effects);
-	for (int i = 0; i < tracks; i++)
-		oshu_mix_track(&audio->effects[i], samples, nb_samples);
-	oshu_mix_track(&audio->looping, samples, nb_samples);
-
-	clip(samples, nb_samples, audio->device_spec.channels);
+	struct oshu_mix_input *inputs = audio->mix_inputs;
+	int count = 0;
+	int active = 0;
+	for (int i = 0; i < audio->voice_count; i++) {
+		struct oshu_track *track = &audio->voices[i].track;
+		if (track->sample)
+			++active;
+		count += oshu_gather_track(track, nb_samples, inputs + count, audio->max_mix_inputs - count);
+	}
+	oshu_mix(samples, nb_samples, inputs, count);
+	audio->active_voices = active;
+	if (active > audio->peak_voices)
+		audio->peak_voices = active;
 }
 
 /**
@@ -87,7 +331,7 @@ static int open_device(struct oshu_audio *audio)
 	want.freq = audio->music.sample_rate;
 	want.format = AUDIO_F32;
 	want.channels = 2;
-	want.samples = sample_buffer_size;
+	want.samples = audio->buffer_size;
 	want.callback = audio_callback;
 	want.userdata = (void*) audio;
 	audio->device_id = SDL_OpenAudioDevice(NULL, 0, &want, &audio->device_spec, 0);
@@ -98,14 +342,135 @@ static int open_device(struct oshu_audio *audio)
 	assert (audio->device_spec.freq == audio->music.sample_rate);
 	assert (audio->device_spec.format == AUDIO_F32);
 	assert (audio->device_spec.channels == 2);
+	audio->last_callback = 0;
+	audio->late_callbacks = 0;
+	oshu_log_debug("opened the audio device with a %d-sample buffer", audio->device_spec.samples);
+	return 0;
+}
+
+/**
+ * Read the buffer size from the OSHU_AUDIO_BUFFER environment variable.
+ *
+ * SDL wants a power of 2, so round it up.
+ */
+static int requested_buffer_size()
+{
+	const char *value = getenv("OSHU_AUDIO_BUFFER");
+	if (!value || !*value)
+		return default_buffer_size;
+	int size = atoi(value);
+	if (size < min_buffer_size || size > default_buffer_size) {
+		oshu_log_warning("invalid OSHU_AUDIO_BUFFER value: %s", value);
+		oshu_log_warning("the buffer size must be between %d and %d samples", min_buffer_size, default_buffer_size);
+		return default_buffer_size;
+	}
+	int power = min_buffer_size;
+	while (power < size)
+		power *= 2;
+	return power;
+}
+
+/**
+ * Read the size of the voice pool from the OSHU_AUDIO_VOICES environment
+ * variable.
+ */
+static int requested_voices()
+{
+	const char *value = getenv("OSHU_AUDIO_VOICES");
+	if (!value || !*value)
+		return default_voices;
+	int count = atoi(value);
+	if (count < 1 || count > max_voices) {
+		oshu_log_warning("invalid OSHU_AUDIO_VOICES value: %s", value);
+		oshu_log_warning("the number of voices must be between 1 and %d", max_voices);
+		return default_voices;
+	}
+	return count;
+}
+
+/**
+ * Allocate the voice pool, and the inputs to mix them.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int create_voices(struct oshu_audio *audio)
+{
+	audio->voice_count = requested_voices();
+	audio->voices = (struct oshu_voice*) calloc(audio->voice_count, sizeof(*audio->voices));
+	audio->max_mix_inputs = audio->voice_count * inputs_per_voice;
+	audio->mix_inputs = (struct oshu_mix_input*) calloc(audio->max_mix_inputs, sizeof(*audio->mix_inputs));
+	if (!audio->voices || !audio->mix_inputs) {
+		oshu_log_error("could not allocate the voice pool");
+		return -1;
+	}
+	audio->active_voices = 0;
+	audio->peak_voices = 0;
+	audio->stolen_voices = 0;
+	audio->dropped_voices = 0;
+	oshu_log_debug("using %d voices for the sound effects", audio->voice_count);
 	return 0;
 }
 
+/**
+ * Tell whether the music should be decoded entirely when opening it, reading
+ * the OSHU_AUDIO_PRELOAD environment variable.
+ *
+ * \sa oshu_preload_stream
+ */
+static bool preload_enabled()
+{
+	const char *value = getenv("OSHU_AUDIO_PRELOAD");
+	return value && *value && strcmp(value, "0");
+}
+
+/**
+ * Main loop of the decoder thread.
+ *
+ * Keep the ring as full as possible, and sleep when it is. Reading the stream
+ * might fail or reach the end, in which case the ring is marked as drained
+ * and the thread waits for a seek, or to be stopped.
+ */
+static void decode_music(struct oshu_audio *audio)
+{
+	float chunk[decode_chunk * channels];
+	while (!audio->stopping) {
+		bool decoded = false;
+		{
+			std::lock_guard<std::mutex> lock(audio->decoding);
+			size_t space = audio->buffer.capacity - oshu_ring_fill(&audio->buffer);
+			if (!audio->drained && space >= (size_t) decode_chunk) {
+				int rc = oshu_read_stream(&audio->music, chunk, decode_chunk);
+				if (rc > 0)
+					oshu_write_ring(&audio->buffer, chunk, rc);
+				if (rc < decode_chunk)
+					audio->drained = true;
+				decoded = true;
+			}
+		}
+		if (!decoded)
+			SDL_Delay(decoder_sleep);
+	}
+}
+
 int oshu_open_audio(const char *url, struct oshu_audio *audio)
 {
 	assert (sizeof(float) == 4);
 	if (oshu_open_stream(url, &audio->music) < 0)
 		goto fail;
+	if (preload_enabled() && oshu_preload_stream(&audio->music) < 0)
+		oshu_log_warning("could not preload the music, streaming it instead");
+	if (oshu_create_ring(&audio->buffer, decode_ahead * audio->music.sample_rate) < 0)
+		goto fail;
+	if (create_voices(audio) < 0)
+		goto fail;
+	audio->position = audio->music.current_timestamp;
+	audio->stopping = false;
+	audio->drained = false;
+	audio->underruns = 0;
+	audio->commands_written = 0;
+	audio->commands_read = 0;
+	audio->buffer_size = requested_buffer_size();
+	audio->decoder = std::thread(decode_music, audio);
 	if (open_device(audio) < 0)
 		goto fail;
 	return 0;
@@ -116,9 +481,31 @@ fail:
 
 void oshu_play_audio(struct oshu_audio *audio)
 {
+	/* the game calls this every frame */
+	if (SDL_GetAudioDeviceStatus(audio->device_id) == SDL_AUDIO_PLAYING)
+		return;
+	/* the pause would be taken for a late callback */
+	audio->last_callback = 0;
 	SDL_PauseAudioDevice(audio->device_id, 0);
 }
 
+void oshu_check_audio(struct oshu_audio *audio)
+{
+	if (audio->late_callbacks < max_late_callbacks || audio->buffer_size >= default_buffer_size)
+		return;
+	audio->buffer_size *= 2;
+	oshu_log_warning("the audio device is running out of samples, raising the buffer size to %d", audio->buffer_size);
+	bool playing = SDL_GetAudioDeviceStatus(audio->device_id) == SDL_AUDIO_PLAYING;
+	SDL_CloseAudioDevice(audio->device_id);
+	audio->device_id = 0;
+	if (open_device(audio) < 0) {
+		oshu_log_error("could not reopen the audio device");
+		return;
+	}
+	if (playing)
+		SDL_PauseAudioDevice(audio->device_id, 0);
+}
+
 void oshu_pause_audio(struct oshu_audio *audio)
 {
 	SDL_PauseAudioDevice(audio->device_id, 1);
@@ -126,70 +513,105 @@ void oshu_pause_audio(struct oshu_audio *audio)
 
 void oshu_close_audio(struct oshu_audio *audio)
 {
-	if (audio->device_id)
+	if (audio->device_id) {
 		SDL_CloseAudioDevice(audio->device_id);
+		audio->device_id = 0;
+	}
+	if (audio->decoder.joinable()) {
+		audio->stopping = true;
+		audio->decoder.join();
+		if (audio->underruns > 0)
+			oshu_log_debug("the audio buffer ran out %d times", (int) audio->underruns);
+	}
+	if (audio->voices && (audio->stolen_voices > 0 || audio->dropped_voices > 0))
+		oshu_log_debug("%d voices were stolen, and %d sounds dropped, with up to %d voices playing", (int) audio->stolen_voices, (int) audio->dropped_voices, (int) audio->peak_voices);
+	free(audio->voices);
+	audio->voices = NULL;
+	audio->voice_count = 0;
+	free(audio->mix_inputs);
+	audio->mix_inputs = NULL;
+	audio->max_mix_inputs = 0;
+	oshu_destroy_ring(&audio->buffer);
 	oshu_close_stream(&audio->music);
 }
 
 /**
- * Pick a track for playing sound effects.
- *
- * If one track is inactive, pick it without hesitation. If all the tracks
- * are active, pick the one with the biggest cursor, because there's a good
- * chance it's about to end.
+ * Send a command to the audio callback.
  *
- * Make sure you lock the audio device when calling this function, in order to
- * ensure predictable results.
+ * Only the game thread may call it. It never waits: when the ring is full,
+ * which means the callback hasn't been called for a while, the command is
+ * dropped.
  */
-static struct oshu_track *select_track(struct oshu_audio *audio)
+static void send_command(struct oshu_audio *audio, const struct oshu_audio_command &command)
 {
-	int max_cursor = 0;
-	struct oshu_track *best_track = &audio->effects[0];
-	int tracks = sizeof(audio->effects) / sizeof(*audio->effects);
-	for (int i = 0; i < tracks; ++i) {
-		struct oshu_track *c = &audio->effects[i];
-		if (c->sample == NULL) {
-			return c;
-		} else if (c->cursor > max_cursor) {
-			max_cursor = c->cursor;
-			best_track = c;
-		}
+	const unsigned capacity = sizeof(audio->commands) / sizeof(*audio->commands);
+	unsigned written = audio->commands_written.load(std::memory_order_relaxed);
+	unsigned read = audio->commands_read.load(std::memory_order_acquire);
+	if (written - read >= capacity) {
+		oshu_log_debug("the audio command ring is full, dropping a command");
+		return;
 	}
-	return best_track;
+	audio->commands[written % capacity] = command;
+	audio->commands_written.store(written + 1, std::memory_order_release);
+}
+
+/**
+ * Ask the audio callback to add a sample to its schedule.
+ */
+static void send_schedule(struct oshu_audio *audio, const struct oshu_scheduled_sample &sound)
+{
+	struct oshu_audio_command command {};
+	command.type = OSHU_SCHEDULE_COMMAND;
+	command.sound = sound;
+	send_command(audio, command);
+}
+
+void oshu_play_sample(struct oshu_audio *audio, struct oshu_sample *sample, float volume, enum oshu_voice_priority priority)
+{
+	oshu_schedule_sample(audio, sample, volume, priority, -INFINITY);
+}
+
+void oshu_play_loop(struct oshu_audio *audio, struct oshu_sample *sample, float volume, int channel)
+{
+	oshu_schedule_loop(audio, sample, volume, channel, -INFINITY);
+}
+
+void oshu_schedule_sample(struct oshu_audio *audio, struct oshu_sample *sample, float volume, enum oshu_voice_priority priority, double time)
+{
+	if (sample)
+		send_schedule(audio, {sample, volume, 0, 0, priority, time});
 }
 
-void oshu_play_sample(struct oshu_audio *audio, struct oshu_sample *sample, float volume)
+void oshu_schedule_loop(struct oshu_audio *audio, struct oshu_sample *sample, float volume, int channel, double time)
 {
-	SDL_LockAudioDevice(audio->device_id);
-	struct oshu_track *track = select_track(audio);
-	if (track->sample != NULL)
-		oshu_log_debug("all the effect tracks are taken, stealing one");
-	oshu_start_track(track, sample, volume, 0);
-	SDL_UnlockAudioDevice(audio->device_id);
+	if (sample)
+		send_schedule(audio, {sample, volume, 1, channel, OSHU_LOOP_PRIORITY, time});
 }
 
-void oshu_play_loop(struct oshu_audio *audio, struct oshu_sample *sample, float volume)
+void oshu_schedule_stop_loop(struct oshu_audio *audio, int channel, double time)
 {
-	SDL_LockAudioDevice(audio->device_id);
-	oshu_start_track(&audio->looping, sample, volume, 1);
-	SDL_UnlockAudioDevice(audio->device_id);
+	send_schedule(audio, {NULL, 0, 1, channel, OSHU_LOOP_PRIORITY, time});
 }
 
 void oshu_stop_loop(struct oshu_audio *audio)
 {
-	SDL_LockAudioDevice(audio->device_id);
-	oshu_stop_track(&audio->looping);
-	SDL_UnlockAudioDevice(audio->device_id);
+	struct oshu_audio_command command {};
+	command.type = OSHU_STOP_LOOP_COMMAND;
+	send_command(audio, command);
 }
 
 int oshu_seek_music(struct oshu_audio *audio, double target)
 {
-	SDL_LockAudioDevice(audio->device_id);
+	struct oshu_audio_command command {};
+	command.type = OSHU_SEEK_COMMAND;
+	std::unique_lock<std::mutex> decoding(audio->decoding);
 	int rc = oshu_seek_stream(&audio->music, target);
-	oshu_stop_track(&audio->looping);
-	int tracks = sizeof(audio->effects) / sizeof(*audio->effects);
-	for (int i = 0; i < tracks; ++i)
-		oshu_stop_track(&audio->effects[i]);
-	SDL_UnlockAudioDevice(audio->device_id);
+	/* the decoder is waiting, so nothing gets written past the mark */
+	command.mark = audio->buffer.write.load(std::memory_order_acquire);
+	command.position = audio->music.current_timestamp;
+	audio->drained = (bool) audio->music.finished;
+	decoding.unlock();
+	audio->position = command.position;
+	send_command(audio, command);
 	return rc;
 }
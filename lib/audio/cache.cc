@@ -0,0 +1,205 @@
+/**
+ * \file audio/cache.cc
+ * \ingroup audio_cache
+ */
+
+#include "audio/cache.h"
+#include "audio/sample.h"
+#include "core/log.h"
+
+#include <SDL2/SDL.h>
+
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+/**
+ * How many bytes of samples nobody uses may stay in the cache.
+ *
+ * The default skin weighs about 2 MB once converted to floats.
+ */
+static const size_t idle_budget = 32 << 20;
+
+struct cached_sample {
+	struct oshu_sample sample;
+	/**
+	 * Key of the entry in #cache::entries, or an empty string when it was
+	 * replaced by a newer version of the file.
+	 */
+	std::string key;
+	/**
+	 * Properties of the file when it was loaded, to detect changes.
+	 */
+	time_t mtime;
+	off_t file_size;
+	int references;
+	/**
+	 * False while a thread is loading the sample. The others wait on
+	 * #cache::loaded.
+	 */
+	bool ready;
+	/**
+	 * Value of #cache::clock when the sample was last released, to find
+	 * the least recently used one.
+	 */
+	unsigned long last_use;
+};
+
+static struct cache {
+	std::mutex lock;
+	std::condition_variable loaded;
+	std::unordered_map<std::string, struct cached_sample*> entries;
+	std::unordered_map<struct oshu_sample*, struct cached_sample*> owners;
+	/**
+	 * Bytes of samples whose reference count is 0.
+	 */
+	size_t idle_size;
+	unsigned long clock;
+	/**
+	 * Free the unused samples when the program exits.
+	 *
+	 * The samples still referenced are left alone, since their owner may
+	 * be destroyed after the cache.
+	 */
+	~cache();
+} cache;
+
+static void destroy_entry(struct cached_sample *entry)
+{
+	cache.owners.erase(&entry->sample);
+	oshu_destroy_sample(&entry->sample);
+	delete entry;
+}
+
+cache::~cache()
+{
+	for (auto it = entries.begin(); it != entries.end();) {
+		struct cached_sample *entry = it->second;
+		it = entries.erase(it);
+		if (entry->references == 0)
+			destroy_entry(entry);
+	}
+}
+
+/**
+ * Remove an entry from #cache::entries, so that nobody acquires it anymore.
+ *
+ * Unused entries are freed right away, and the others when they're released.
+ */
+static void detach_entry(struct cached_sample *entry)
+{
+	cache.entries.erase(entry->key);
+	entry->key.clear();
+	if (entry->references == 0) {
+		cache.idle_size -= entry->sample.size;
+		destroy_entry(entry);
+	}
+}
+
+/**
+ * Free the least recently used samples until the unused ones fit in the
+ * #idle_budget.
+ */
+static void trim_cache()
+{
+	while (cache.idle_size > idle_budget) {
+		struct cached_sample *oldest = NULL;
+		for (auto &it : cache.entries) {
+			struct cached_sample *entry = it.second;
+			if (entry->references == 0 && (!oldest || entry->last_use < oldest->last_use))
+				oldest = entry;
+		}
+		if (!oldest)
+			break;
+		oshu_log_debug("evicting %s from the sample cache", oldest->key.c_str());
+		detach_entry(oldest);
+	}
+}
+
+/**
+ * Build the cache key of a file for a device format.
+ */
+static std::string make_key(const char *absolute, struct SDL_AudioSpec *spec)
+{
+	std::ostringstream os;
+	os << absolute << ':' << spec->freq << ':' << spec->format << ':' << (int) spec->channels;
+	return os.str();
+}
+
+struct oshu_sample* oshu_acquire_sample(const char *path, struct SDL_AudioSpec *spec)
+{
+	char *absolute = realpath(path, NULL);
+	struct stat st;
+	if (!absolute || stat(absolute, &st) < 0) {
+		oshu_log_debug("could not find sample %s", path);
+		free(absolute);
+		return NULL;
+	}
+	std::string key = make_key(absolute, spec);
+	free(absolute);
+
+	std::unique_lock<std::mutex> lock(cache.lock);
+	for (;;) {
+		auto it = cache.entries.find(key);
+		if (it == cache.entries.end())
+			break;
+		struct cached_sample *entry = it->second;
+		if (!entry->ready) {
+			cache.loaded.wait(lock);
+			continue;
+		}
+		if (entry->mtime != st.st_mtime || entry->file_size != st.st_size) {
+			oshu_log_debug("%s changed, reloading it", path);
+			detach_entry(entry);
+			break;
+		}
+		if (entry->references++ == 0)
+			cache.idle_size -= entry->sample.size;
+		return &entry->sample;
+	}
+
+	struct cached_sample *entry = new cached_sample {};
+	entry->key = key;
+	entry->mtime = st.st_mtime;
+	entry->file_size = st.st_size;
+	entry->references = 1;
+	cache.entries[key] = entry;
+	cache.owners[&entry->sample] = entry;
+
+	/* let the other threads load other samples meanwhile */
+	lock.unlock();
+	oshu_log_debug("loading sample %s", path);
+	if (oshu_load_sample(path, spec, &entry->sample) < 0) {
+		oshu_log_debug("continuing the process with an empty sample");
+		entry->sample = {};
+	}
+	lock.lock();
+	entry->ready = true;
+	cache.loaded.notify_all();
+	return &entry->sample;
+}
+
+void oshu_release_sample(struct oshu_sample *sample)
+{
+	std::lock_guard<std::mutex> lock(cache.lock);
+	auto it = cache.owners.find(sample);
+	if (it == cache.owners.end()) {
+		oshu_log_warning("releasing a sample that is not in the cache");
+		return;
+	}
+	struct cached_sample *entry = it->second;
+	if (--entry->references > 0)
+		return;
+	if (entry->key.empty()) {
+		destroy_entry(entry);
+		return;
+	}
+	entry->last_use = ++cache.clock;
+	cache.idle_size += entry->sample.size;
+	trim_cache();
+}
@@ -7,16 +7,29 @@
 
 #include "audio/library.h"
 #include "audio/audio.h"
+#include "audio/cache.h"
 #include "audio/sample.h"
 #include "core/log.h"
 
 #include <assert.h>
+#include <dirent.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <SDL2/SDL_timer.h>
+#include <set>
 #include <sstream>
+#include <tuple>
+
+/**
+ * Number of threads loading the samples of a beatmap.
+ *
+ * Most of the time goes into reading and resampling small files, so a few
+ * threads are enough to keep the disk busy.
+ */
+static const int loader_workers = 4;
 
 /**
  * Determine the directory of the skin to use.
@@ -51,13 +64,13 @@ void oshu_open_sound_library(struct oshu_sound_library *library, struct SDL_Audi
 	library->skin_directory = skin_directory();
 	oshu_log_debug("using skin directory %s", library->skin_directory.c_str());
 	library->format = format;
+	library->cancelled = false;
 }
 
 static void free_sample(struct oshu_sample **sample)
 {
 	if (*sample) {
-		oshu_destroy_sample(*sample);
-		free(*sample);
+		oshu_release_sample(*sample);
 		*sample = NULL;
 	}
 }
@@ -84,8 +97,18 @@ static void free_room(struct oshu_sound_room *room)
 	room->indices = NULL;
 }
 
+static void collect_loaded(struct oshu_sound_library *library);
+
 void oshu_close_sound_library(struct oshu_sound_library *library)
 {
+	/* skip the queued loads, wait for the ones in progress, and release
+	 * their samples too */
+	library->cancelled = true;
+	library->loader.reset();
+	collect_loaded(library);
+	library->beatmap_files.clear();
+	library->beatmap_listed = false;
+	library->resolved.clear();
 	free_room(&library->normal);
 	free_room(&library->soft);
 	free_room(&library->drum);
@@ -236,7 +259,7 @@ static std::string locate_sample(oshu_sound_library *library, enum oshu_sample_s
 		return {};
 	if (index > 0) {
 		/* Check the current directory. */
-		if (access(filename.c_str(), R_OK) == 0)
+		if (library->beatmap_listed ? library->beatmap_files.count(filename) : access(filename.c_str(), R_OK) == 0)
 			return filename;
 	} else {
 		/* Check the installation's data directory. */
@@ -265,27 +288,46 @@ int oshu_register_sample(struct oshu_sound_library *library, enum oshu_sample_se
 	std::string path = locate_sample(library, set, index, type);
 	if (path.empty())
 		return -1;
+	/* the fallbacks may change too */
+	library->resolved.clear();
 	oshu_log_debug("registering %s", path.c_str());
-	*sample = (oshu_sample*) calloc(1, sizeof(**sample));
-	assert (*sample != NULL);
 	assert (library->format != NULL);
-	int rc = oshu_load_sample(path.c_str(), library->format, *sample);
-	if (rc < 0)
-		oshu_log_debug("continuing the process with an empty sample");
+	*sample = oshu_acquire_sample(path.c_str(), library->format);
+	if (!*sample)
+		return -1;
 	return 0;
 }
 
-void oshu_register_sound(struct oshu_sound_library *library, struct oshu_hit_sound *sound)
+/**
+ * List the samples a hit sound needs, for its index.
+ *
+ * \return The number of samples written into *sets* and *types*, up to 4.
+ */
+static int sound_samples(struct oshu_hit_sound *sound, enum oshu_sample_set_family *sets, int *types)
 {
+	int count = 0;
 	int target = sound->additions & OSHU_SOUND_TARGET;
-	if (sound->additions & OSHU_NORMAL_SOUND)
-		oshu_register_sample(library, sound->sample_set, sound->index, target | OSHU_NORMAL_SOUND);
-	if (sound->additions & OSHU_WHISTLE_SOUND)
-		oshu_register_sample(library, sound->additions_set, sound->index, target | OSHU_WHISTLE_SOUND);
-	if (sound->additions & OSHU_FINISH_SOUND)
-		oshu_register_sample(library, sound->additions_set, sound->index, target | OSHU_FINISH_SOUND);
-	if (sound->additions & OSHU_CLAP_SOUND)
-		oshu_register_sample(library, sound->additions_set, sound->index, target | OSHU_CLAP_SOUND);
+	if (sound->additions & OSHU_NORMAL_SOUND) {
+		sets[count] = sound->sample_set;
+		types[count++] = target | OSHU_NORMAL_SOUND;
+	}
+	static const enum oshu_sound_type additions[] = {OSHU_WHISTLE_SOUND, OSHU_FINISH_SOUND, OSHU_CLAP_SOUND};
+	for (enum oshu_sound_type flag : additions) {
+		if (sound->additions & flag) {
+			sets[count] = sound->additions_set;
+			types[count++] = target | flag;
+		}
+	}
+	return count;
+}
+
+void oshu_register_sound(struct oshu_sound_library *library, struct oshu_hit_sound *sound)
+{
+	enum oshu_sample_set_family sets[4];
+	int types[4];
+	int count = sound_samples(sound, sets, types);
+	for (int i = 0; i < count; ++i)
+		oshu_register_sample(library, sets[i], sound->index, types[i]);
 }
 
 static void populate_default(struct oshu_sound_library *library, enum oshu_sample_set_family set)
@@ -298,6 +340,83 @@ static void populate_default(struct oshu_sound_library *library, enum oshu_sampl
 	oshu_register_sample(library, set, OSHU_DEFAULT_SHELF, OSHU_SLIDER_SOUND|OSHU_WHISTLE_SOUND);
 }
 
+/**
+ * List the files of the beatmap directory into
+ * #oshu_sound_library::beatmap_files.
+ *
+ * If the directory can't be read, the files are probed one by one instead.
+ */
+static void list_beatmap_files(struct oshu_sound_library *library)
+{
+	DIR *dir = opendir(".");
+	if (!dir) {
+		oshu_log_debug("could not list the beatmap directory");
+		return;
+	}
+	while (struct dirent *entry = readdir(dir))
+		library->beatmap_files.insert(entry->d_name);
+	closedir(dir);
+	library->beatmap_listed = true;
+}
+
+/**
+ * Pack the attributes of a sample into a key of
+ * #oshu_sound_library::resolved.
+ */
+static uint64_t sample_key(enum oshu_sample_set_family set, int index, int type)
+{
+	return (uint64_t) (uint32_t) index << 32 | (uint64_t) (uint8_t) set << 8 | (uint8_t) type;
+}
+
+/**
+ * Move the samples the #oshu_sound_library::loader finished loading to their
+ * shelf.
+ *
+ * Only the game thread may call it, since it owns the shelves.
+ */
+static void collect_loaded(struct oshu_sound_library *library)
+{
+	if (library->pending == 0)
+		return;
+	std::vector<struct oshu_loaded_sample> loaded;
+	{
+		std::lock_guard<std::mutex> lock(library->loading);
+		loaded.swap(library->loaded);
+	}
+	for (struct oshu_loaded_sample &l : loaded) {
+		struct oshu_sound_room *room = get_room(library, l.set);
+		struct oshu_sound_shelf *shelf = room ? find_shelf(room, l.index) : NULL;
+		struct oshu_sample **sample = shelf ? get_sample(shelf, l.type) : NULL;
+		if (sample && !*sample) {
+			*sample = l.sample;
+			library->resolved.erase(sample_key(l.set, l.index, l.type));
+		} else if (l.sample) {
+			oshu_release_sample(l.sample);
+		}
+	}
+	library->pending -= loaded.size();
+}
+
+/**
+ * Prepare the shelf for a sample of the beatmap, and add it to *requests* if
+ * it needs to be loaded.
+ *
+ * The samples of the default shelf were already loaded.
+ */
+static void request_sample(struct oshu_sound_library *library, enum oshu_sample_set_family set, int index, int type, std::set<std::tuple<int, int, int>> &requested, std::vector<struct oshu_loaded_sample> &requests)
+{
+	if (index == OSHU_DEFAULT_SHELF)
+		return;
+	if (!requested.insert(std::make_tuple((int) set, index, type)).second)
+		return;
+	struct oshu_sound_room *room = get_room(library, set);
+	if (!room)
+		return;
+	if (!find_shelf(room, index))
+		new_shelf(room, index);
+	requests.push_back({set, index, type, NULL});
+}
+
 void oshu_populate_library(struct oshu_sound_library *library, struct oshu_beatmap *beatmap)
 {
 	int start = SDL_GetTicks();
@@ -305,26 +424,59 @@ void oshu_populate_library(struct oshu_sound_library *library, struct oshu_beatm
 	populate_default(library, OSHU_NORMAL_SAMPLE_SET);
 	populate_default(library, OSHU_SOFT_SAMPLE_SET);
 	populate_default(library, OSHU_DRUM_SAMPLE_SET);
+	int end = SDL_GetTicks();
+	oshu_log_debug("loaded the default samples in %.3f seconds", (end - start) / 1000.);
+
+	/* list the samples of the beatmap, in the order they're first needed */
+	list_beatmap_files(library);
+	std::set<std::tuple<int, int, int>> requested;
+	std::vector<struct oshu_loaded_sample> requests;
+	enum oshu_sample_set_family sets[4];
+	int types[4];
 	for (struct oshu_hit *hit = beatmap->hits; hit; hit = hit->next) {
+		int count = sound_samples(&hit->sound, sets, types);
+		for (int i = 0; i < count; ++i)
+			request_sample(library, sets[i], hit->sound.index, types[i], requested, requests);
 		if (hit->type & OSHU_SLIDER_HIT) {
-			for (int i = 0; i <= hit->slider.repeat; ++i)
-				oshu_register_sound(library, &hit->slider.sounds[i]);
+			for (int t = 0; t <= hit->slider.repeat; ++t) {
+				struct oshu_hit_sound *sound = &hit->slider.sounds[t];
+				count = sound_samples(sound, sets, types);
+				for (int i = 0; i < count; ++i)
+					request_sample(library, sets[i], sound->index, types[i], requested, requests);
+			}
 		}
-		oshu_register_sound(library, &hit->sound);
 	}
-	int end = SDL_GetTicks();
-	oshu_log_debug("done loading the library in %.3f seconds", (end - start) / 1000.);
+
+	int submitted = 0;
+	for (auto it = requests.rbegin(); it != requests.rend(); ++it) {
+		std::string path = locate_sample(library, it->set, it->index, it->type);
+		if (path.empty())
+			continue;
+		if (!library->loader)
+			library->loader.reset(new oshu::thread_pool(loader_workers));
+		++library->pending;
+		++submitted;
+		/* the workers run the last task of their queue first, which is
+		 * why the requests are submitted backward */
+		struct oshu_loaded_sample request = *it;
+		library->loader->submit([library, request, path] {
+			struct oshu_loaded_sample done = request;
+			if (!library->cancelled)
+				done.sample = oshu_acquire_sample(path.c_str(), library->format);
+			std::lock_guard<std::mutex> lock(library->loading);
+			library->loaded.push_back(done);
+		});
+	}
+	oshu_log_debug("loading %d beatmap samples in the background", submitted);
 }
 
 /**
- * Find a sample given its attributes.
+ * Search the shelves for a sample given its attributes.
  *
  * If the wanted sample couldn't be found, return a sane replacement or, in the
  * worst case scenario, NULL.
- *
- * \sa oshu_play_sound
  */
-struct oshu_sample* find_sample(struct oshu_sound_library *library, enum oshu_sample_set_family set, int index, int type)
+static struct oshu_sample* search_sample(struct oshu_sound_library *library, enum oshu_sample_set_family set, int index, int type)
 {
 	struct oshu_sample **sample {nullptr};
 	struct oshu_sound_room *room = get_room(library, set);
@@ -346,7 +498,25 @@ round2:
 	return *sample;
 }
 
-static void try_sound(struct oshu_sound_library *library, struct oshu_hit_sound *sound, struct oshu_audio *audio, enum oshu_sound_type flag)
+/**
+ * Find a sample given its attributes, like #search_sample, but remember the
+ * result in #oshu_sound_library::resolved.
+ *
+ * \sa oshu_play_sound
+ */
+struct oshu_sample* find_sample(struct oshu_sound_library *library, enum oshu_sample_set_family set, int index, int type)
+{
+	collect_loaded(library);
+	uint64_t key = sample_key(set, index, type);
+	auto it = library->resolved.find(key);
+	if (it != library->resolved.end())
+		return it->second;
+	struct oshu_sample *sample = search_sample(library, set, index, type);
+	library->resolved[key] = sample;
+	return sample;
+}
+
+static void try_sound(struct oshu_sound_library *library, struct oshu_hit_sound *sound, struct oshu_audio *audio, enum oshu_sound_type flag, int channel, double time)
 {
 	if (sound->additions & flag) {
 		int target = sound->additions & OSHU_SOUND_TARGET;
@@ -355,16 +525,24 @@ static void try_sound(struct oshu_sound_library *library, struct oshu_hit_sound
 		if (!sample)
 			return;
 		else if (sound->additions & OSHU_SLIDER_SOUND)
-			oshu_play_loop(audio, sample, sound->volume);
+			oshu_schedule_loop(audio, sample, sound->volume, channel, time);
+		else if (flag & (OSHU_FINISH_SOUND | OSHU_CLAP_SOUND))
+			oshu_schedule_sample(audio, sample, sound->volume, OSHU_HIGH_PRIORITY, time);
 		else
-			oshu_play_sample(audio, sample, sound->volume);
+			oshu_schedule_sample(audio, sample, sound->volume, OSHU_NORMAL_PRIORITY, time);
 	}
 }
 
+void oshu_schedule_sound(struct oshu_sound_library *library, struct oshu_hit_sound *sound, struct oshu_audio *audio, int channel, double time)
+{
+	try_sound(library, sound, audio, OSHU_NORMAL_SOUND, channel, time);
+	try_sound(library, sound, audio, OSHU_WHISTLE_SOUND, channel, time);
+	try_sound(library, sound, audio, OSHU_FINISH_SOUND, channel, time);
+	try_sound(library, sound, audio, OSHU_CLAP_SOUND, channel, time);
+}
+
 void oshu_play_sound(struct oshu_sound_library *library, struct oshu_hit_sound *sound, struct oshu_audio *audio)
 {
-	try_sound(library, sound, audio, OSHU_NORMAL_SOUND);
-	try_sound(library, sound, audio, OSHU_WHISTLE_SOUND);
-	try_sound(library, sound, audio, OSHU_FINISH_SOUND);
-	try_sound(library, sound, audio, OSHU_CLAP_SOUND);
+	/* anything in the past is played as soon as possible */
+	oshu_schedule_sound(library, sound, audio, 0, -INFINITY);
 }
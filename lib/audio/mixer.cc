@@ -0,0 +1,140 @@
+/**
+ * \file audio/mixer.cc
+ * \ingroup audio_mixer
+ */
+
+#include "audio/mixer.h"
+
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define OSHU_MIXER_X86
+#include <immintrin.h>
+#endif
+
+/** Work in stereo. */
+static const int channels = 2;
+
+/**
+ * Number of samples per channel processed at once.
+ *
+ * A block is 4 KB, so that it stays in the L1 cache while the inputs are
+ * added.
+ */
+static const int block_size = 512;
+
+/**
+ * The inner loops of the mixer, for one instruction set.
+ *
+ * Sizes are in floats.
+ */
+struct mixer_kernels {
+	void (*accumulate)(float *output, const float *input, int size, float volume);
+	void (*clip)(float *samples, int size);
+};
+
+static void accumulate_c(float *output, const float *input, int size, float volume)
+{
+	for (int i = 0; i < size; ++i)
+		output[i] = fmaf(input[i], volume, output[i]);
+}
+
+static void clip_c(float *samples, int size)
+{
+	for (int i = 0; i < size; ++i)
+		samples[i] = fminf(fmaxf(samples[i], -1.f), 1.f);
+}
+
+#ifdef OSHU_MIXER_X86
+
+__attribute__((target("sse2")))
+static void accumulate_sse2(float *output, const float *input, int size, float volume)
+{
+	__m128 v = _mm_set1_ps(volume);
+	int i = 0;
+	for (; i + 4 <= size; i += 4) {
+		__m128 x = _mm_mul_ps(_mm_loadu_ps(input + i), v);
+		_mm_storeu_ps(output + i, _mm_add_ps(_mm_loadu_ps(output + i), x));
+	}
+	accumulate_c(output + i, input + i, size - i, volume);
+}
+
+__attribute__((target("sse2")))
+static void clip_sse2(float *samples, int size)
+{
+	__m128 low = _mm_set1_ps(-1.f);
+	__m128 high = _mm_set1_ps(1.f);
+	int i = 0;
+	for (; i + 4 <= size; i += 4) {
+		__m128 x = _mm_loadu_ps(samples + i);
+		_mm_storeu_ps(samples + i, _mm_min_ps(_mm_max_ps(x, low), high));
+	}
+	clip_c(samples + i, size - i);
+}
+
+__attribute__((target("avx2,fma")))
+static void accumulate_avx2(float *output, const float *input, int size, float volume)
+{
+	__m256 v = _mm256_set1_ps(volume);
+	int i = 0;
+	for (; i + 8 <= size; i += 8) {
+		__m256 x = _mm256_loadu_ps(input + i);
+		_mm256_storeu_ps(output + i, _mm256_fmadd_ps(x, v, _mm256_loadu_ps(output + i)));
+	}
+	accumulate_c(output + i, input + i, size - i, volume);
+}
+
+__attribute__((target("avx2")))
+static void clip_avx2(float *samples, int size)
+{
+	__m256 low = _mm256_set1_ps(-1.f);
+	__m256 high = _mm256_set1_ps(1.f);
+	int i = 0;
+	for (; i + 8 <= size; i += 8) {
+		__m256 x = _mm256_loadu_ps(samples + i);
+		_mm256_storeu_ps(samples + i, _mm256_min_ps(_mm256_max_ps(x, low), high));
+	}
+	clip_c(samples + i, size - i);
+}
+
+#endif
+
+/**
+ * Pick the best kernels the CPU supports.
+ */
+static struct mixer_kernels select_kernels()
+{
+#ifdef OSHU_MIXER_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return {accumulate_avx2, clip_avx2};
+	if (__builtin_cpu_supports("sse2"))
+		return {accumulate_sse2, clip_sse2};
+#endif
+	return {accumulate_c, clip_c};
+}
+
+static const struct mixer_kernels kernels = select_kernels();
+
+void oshu_mix(float *samples, int nb_samples, const struct oshu_mix_input *inputs, int count)
+{
+	for (int start = 0; start < nb_samples; start += block_size) {
+		int end = start + block_size < nb_samples ? start + block_size : nb_samples;
+		for (int i = 0; i < count; ++i) {
+			const struct oshu_mix_input *input = &inputs[i];
+			int from = input->offset > start ? input->offset : start;
+			int to = input->offset + input->length;
+			if (to > end)
+				to = end;
+			if (from >= to)
+				continue;
+			kernels.accumulate(
+				samples + from * channels,
+				input->samples + (from - input->offset) * channels,
+				(to - from) * channels,
+				input->volume
+			);
+		}
+		kernels.clip(samples + start * channels, (end - start) * channels);
+	}
+}
@@ -0,0 +1,93 @@
+/**
+ * \file audio/ring.cc
+ * \ingroup audio_ring
+ */
+
+#include "audio/ring.h"
+#include "core/log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/** Work in stereo. */
+static const int channels = 2;
+
+int oshu_create_ring(struct oshu_ring *ring, size_t capacity)
+{
+	size_t size = 1;
+	while (size < capacity)
+		size *= 2;
+	ring->samples = (float*) calloc(size * channels, sizeof(float));
+	if (!ring->samples) {
+		oshu_log_error("could not allocate the audio ring");
+		return -1;
+	}
+	ring->capacity = size;
+	ring->read = 0;
+	ring->write = 0;
+	return 0;
+}
+
+void oshu_destroy_ring(struct oshu_ring *ring)
+{
+	free(ring->samples);
+	ring->samples = NULL;
+	ring->capacity = 0;
+}
+
+size_t oshu_ring_fill(struct oshu_ring *ring)
+{
+	return ring->write.load(std::memory_order_acquire) - ring->read.load(std::memory_order_acquire);
+}
+
+/**
+ * Copy *count* samples per channel between a linear buffer and the ring,
+ * starting at *position*, wrapping around the end of the ring if needed.
+ */
+static void copy_ring(struct oshu_ring *ring, size_t position, float *samples, size_t count, bool to_ring)
+{
+	size_t offset = position & (ring->capacity - 1);
+	size_t first = ring->capacity - offset;
+	if (first > count)
+		first = count;
+	float *start = ring->samples + offset * channels;
+	size_t first_size = first * channels * sizeof(float);
+	size_t second_size = (count - first) * channels * sizeof(float);
+	if (to_ring) {
+		memcpy(start, samples, first_size);
+		memcpy(ring->samples, samples + first * channels, second_size);
+	} else {
+		memcpy(samples, start, first_size);
+		memcpy(samples + first * channels, ring->samples, second_size);
+	}
+}
+
+size_t oshu_write_ring(struct oshu_ring *ring, const float *samples, size_t nb_samples)
+{
+	size_t write = ring->write.load(std::memory_order_relaxed);
+	size_t read = ring->read.load(std::memory_order_acquire);
+	size_t space = ring->capacity - (write - read);
+	size_t count = nb_samples < space ? nb_samples : space;
+	copy_ring(ring, write, (float*) samples, count, true);
+	ring->write.store(write + count, std::memory_order_release);
+	return count;
+}
+
+size_t oshu_read_ring(struct oshu_ring *ring, float *samples, size_t nb_samples)
+{
+	size_t read = ring->read.load(std::memory_order_relaxed);
+	size_t write = ring->write.load(std::memory_order_acquire);
+	size_t available = write - read;
+	size_t count = nb_samples < available ? nb_samples : available;
+	copy_ring(ring, read, samples, count, false);
+	ring->read.store(read + count, std::memory_order_release);
+	return count;
+}
+
+void oshu_skip_ring(struct oshu_ring *ring, size_t mark)
+{
+	size_t read = ring->read.load(std::memory_order_relaxed);
+	/* the difference is signed because the indices may wrap */
+	if ((ptrdiff_t) (mark - read) > 0)
+		ring->read.store(mark, std::memory_order_release);
+}
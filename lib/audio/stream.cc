@@ -13,6 +13,8 @@ extern "C" {
 }
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 
 /** Work in stereo. */
 static const int channels = 2;
@@ -134,8 +136,25 @@ static int convert_frame(struct SwrContext *converter, AVFrame *frame, int index
 	return rc;
 }
 
+/**
+ * Read samples from #oshu_stream::pcm.
+ */
+static int read_pcm(struct oshu_stream *stream, float *samples, int nb_samples)
+{
+	int left = stream->pcm_samples - stream->pcm_cursor;
+	int count = left < nb_samples ? left : nb_samples;
+	memcpy(samples, stream->pcm + stream->pcm_cursor * channels, count * channels * sizeof(float));
+	stream->pcm_cursor += count;
+	stream->current_timestamp = stream->pcm_start + (double) stream->pcm_cursor / stream->sample_rate;
+	if (stream->pcm_cursor >= stream->pcm_samples)
+		stream->finished = 1;
+	return count;
+}
+
 int oshu_read_stream(struct oshu_stream *stream, float *samples, int nb_samples)
 {
+	if (stream->pcm)
+		return read_pcm(stream, samples, nb_samples);
 	int left = nb_samples;
 	while (left > 0 && !stream->finished) {
 		if (stream->sample_index >= stream->frame->nb_samples) {
@@ -297,8 +316,55 @@ fail:
 	return -1;
 }
 
+int oshu_preload_stream(struct oshu_stream *stream)
+{
+	assert (stream->pcm == NULL);
+	double start = stream->current_timestamp;
+	/* reserve a bit more than the announced duration, which is often rounded */
+	size_t capacity = (stream->duration > 0 ? stream->duration + 1 : 60) * stream->sample_rate;
+	size_t size = 0;
+	float *pcm = NULL;
+	while (!stream->finished) {
+		if (size == capacity || !pcm) {
+			if (pcm)
+				capacity *= 2;
+			float *grown = (float*) realloc(pcm, capacity * channels * sizeof(float));
+			if (!grown) {
+				oshu_log_error("not enough memory to preload the audio stream");
+				goto fail;
+			}
+			pcm = grown;
+		}
+		int rc = oshu_read_stream(stream, pcm + size * channels, capacity - size);
+		if (rc < 0)
+			goto fail;
+		size += rc;
+	}
+	stream->pcm = pcm;
+	stream->pcm_samples = size;
+	stream->pcm_cursor = 0;
+	stream->pcm_start = start;
+	stream->current_timestamp = start;
+	stream->duration = start + (double) size / stream->sample_rate;
+	stream->finished = size == 0;
+	oshu_log_debug("preloaded %.3f seconds of audio", (double) size / stream->sample_rate);
+	return 0;
+fail:
+	free(pcm);
+	/* go back to where we started, for the caller to stream it instead */
+	if (oshu_seek_stream(stream, start) < 0)
+		oshu_log_warning("could not rewind the audio stream after preloading failed");
+	else
+		stream->finished = 0;
+	return -1;
+}
+
 void oshu_close_stream(struct oshu_stream *stream)
 {
+	if (stream->pcm) {
+		free(stream->pcm);
+		stream->pcm = NULL;
+	}
 	/* the av routines set the pointers to NULL */
 	if (stream->frame)
 		av_frame_free(&stream->frame);
@@ -318,6 +384,13 @@ int oshu_seek_stream(struct oshu_stream *stream, double target)
 		oshu_log_warning("cannot seek past the end of the stream");
 		return -1;
 	}
+	if (stream->pcm) {
+		int cursor = (target - stream->pcm_start) * stream->sample_rate;
+		stream->pcm_cursor = cursor < 0 ? 0 : cursor;
+		stream->current_timestamp = stream->pcm_start + (double) stream->pcm_cursor / stream->sample_rate;
+		stream->finished = stream->pcm_cursor >= stream->pcm_samples;
+		return 0;
+	}
 	int rc = av_seek_frame(
 		stream->demuxer,
 		stream->stream->index,
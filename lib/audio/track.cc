@@ -3,11 +3,11 @@
  * \ingroup audio_track
  */
 
+#include "audio/mixer.h"
 #include "audio/sample.h"
 #include "audio/track.h"
 
 #include <assert.h>
-#include <math.h>
 #include <stdlib.h>
 
 /** Work in stereo. */
@@ -21,6 +21,7 @@ void oshu_start_track(struct oshu_track *track, struct oshu_sample *sample, floa
 	track->cursor = 0;
 	track->volume = volume;
 	track->loop = loop;
+	track->delay = 0;
 }
 
 void oshu_stop_track(struct oshu_track *track)
@@ -28,10 +29,15 @@ void oshu_stop_track(struct oshu_track *track)
 	track->sample = NULL;
 }
 
-int oshu_mix_track(struct oshu_track *track, float *samples, int nb_samples)
+int oshu_gather_track(struct oshu_track *track, int nb_samples, struct oshu_mix_input *inputs, int max_inputs)
 {
-	int wanted = nb_samples;
-	while (wanted > 0 && track->sample) {
+	int count = 0;
+	int offset = 0;
+	if (track->sample && track->delay > 0) {
+		offset = track->delay < nb_samples ? track->delay : nb_samples;
+		track->delay -= offset;
+	}
+	while (offset < nb_samples && track->sample && count < max_inputs) {
 		int left = track->sample->nb_samples - track->cursor;
 		if (left == 0) {
 			if (track->loop) {
@@ -42,13 +48,26 @@ int oshu_mix_track(struct oshu_track *track, float *samples, int nb_samples)
 			}
 			continue;
 		}
+		int wanted = nb_samples - offset;
 		int consume = left < wanted ? left : wanted;
-		float *input = track->sample->samples + track->cursor * channels;
-		for (int i = 0; i < consume * channels; i++)
-			samples[i] = fmaf(input[i], track->volume, samples[i]);
+		struct oshu_mix_input *input = &inputs[count++];
+		input->samples = track->sample->samples + track->cursor * channels;
+		input->offset = offset;
+		input->length = consume;
+		input->volume = track->volume;
 		track->cursor += consume;
-		samples += consume * channels;
-		wanted -= consume;
+		offset += consume;
+	}
+	/* out of inputs: skip the rest, so that the track keeps its pace */
+	if (offset < nb_samples && track->sample) {
+		int skipped = nb_samples - offset;
+		int total = track->sample->nb_samples;
+		if (track->loop)
+			track->cursor = (track->cursor + skipped) % total;
+		else if (track->cursor + skipped < total)
+			track->cursor += skipped;
+		else
+			track->sample = NULL;
 	}
-	return nb_samples - wanted;
+	return count;
 }
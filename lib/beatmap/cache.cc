@@ -0,0 +1,611 @@
+/**
+ * \file beatmap/cache.cc
+ * \ingroup beatmap
+ *
+ * \brief
+ * Compiled beatmap cache.
+ *
+ * A cache file is a snapshot of an #oshu_beatmap right after it was parsed. It
+ * starts with a #cache_header, which holds a copy of the beatmap structure
+ * itself, followed by the arrays of timing points, colors and hits, and
+ * finally the blobs they reference: slider sounds, Bézier arrays, and strings.
+ *
+ * Pointers can't be saved as is, so they are *swizzled* into integers before
+ * being written:
+ *
+ * - Strings and arrays become offsets from the beginning of the file. Every
+ *   blob comes after the header, so a null offset unambiguously means a null
+ *   pointer.
+ * - Timing points and colors referenced by hits become their index in their
+ *   array, plus one.
+ * - The links of the lists are not saved at all, since they follow the array
+ *   order.
+ *
+ * Loading a beatmap from the cache is a matter of mapping the file in memory
+ * and turning the integers back into pointers in place. The hits, timing
+ * points, strings and paths are used directly from the mapping, which is
+ * private so that the game may freely change the state of the hits.
+ *
+ * The file is only valid for the machine and version of oshu! that wrote it,
+ * since it holds raw structures. The header records the size of every
+ * structure to detect incompatible builds, on top of a version number to bump
+ * whenever the meaning of a structure changes.
+ */
+
+#include "beatmap/beatmap.h"
+#include "core/log.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Every cache file must begin with this, including the final null byte.
+ */
+static const char cache_magic[8] = "oshu!bc";
+
+/**
+ * Bump it every time the layout of the cache changes in a way the structure
+ * sizes wouldn't catch.
+ */
+static const uint32_t cache_version = 1;
+
+/**
+ * Alignment of every array and blob in the cache file, to make them directly
+ * usable from the mapping.
+ */
+static const size_t cache_alignment = alignof(max_align_t);
+
+struct cache_header {
+	char magic[8];
+	uint32_t version;
+	/**
+	 * Sizes of the structures, to detect caches written by a different
+	 * build.
+	 */
+	uint32_t beatmap_size;
+	uint32_t hit_size;
+	uint32_t timing_point_size;
+	uint32_t color_size;
+	/**
+	 * Properties of the .osu file when the cache was written.
+	 *
+	 * If any changes, the cache is stale.
+	 */
+	uint64_t source_size;
+	int64_t source_mtime_sec;
+	int64_t source_mtime_nsec;
+	/**
+	 * Total size of the cache file, header included.
+	 */
+	uint64_t size;
+	uint64_t timing_points_offset;
+	int32_t timing_point_count;
+	uint64_t colors_offset;
+	uint64_t hits_offset;
+	/**
+	 * Including the two unreachable hits.
+	 */
+	int32_t hit_count;
+	/**
+	 * The beatmap, with its pointers swizzled.
+	 *
+	 * #oshu_beatmap::timing_points, #oshu_beatmap::colors and
+	 * #oshu_beatmap::hits are meaningless, and rebuilt from the offsets
+	 * above.
+	 */
+	struct oshu_beatmap beatmap;
+};
+
+/**
+ * Read the location of the cache directory from the environment, like
+ * oshu-library does for the oshu! home.
+ *
+ * It is `$OSHU_HOME/cache`, or `$HOME/.oshu/cache`.
+ *
+ * The directory may not exist yet. See #create_cache_directory.
+ */
+static int cache_directory(char *dir, size_t size)
+{
+	int rc;
+	const char *home = getenv("OSHU_HOME");
+	if (home && *home)
+		rc = snprintf(dir, size, "%s/cache", home);
+	else if ((home = getenv("HOME")) && *home)
+		rc = snprintf(dir, size, "%s/.oshu/cache", home);
+	else
+		return -1;
+	if (rc < 0 || (size_t) rc >= size)
+		return -1;
+	return 0;
+}
+
+/**
+ * Create the cache directory, and the oshu! home above it, if needed.
+ *
+ * Only writing the cache needs them, so looking a beatmap up in the cache
+ * never creates anything.
+ */
+static int create_cache_directory()
+{
+	char dir[PATH_MAX];
+	if (cache_directory(dir, sizeof(dir)) < 0)
+		return -1;
+	char *slash = strrchr(dir, '/');
+	assert (slash != NULL);
+	*slash = '\0';
+	if (mkdir(dir, 0777) < 0 && errno != EEXIST)
+		return -1;
+	*slash = '/';
+	if (mkdir(dir, 0777) < 0 && errno != EEXIST)
+		return -1;
+	return 0;
+}
+
+/**
+ * 64-bit FNV-1a hash, used to name cache files after the beatmap's path.
+ */
+static uint64_t hash_string(const char *str)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (const unsigned char *c = (const unsigned char*) str; *c; ++c) {
+		hash ^= *c;
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+/**
+ * Compute the path to the cache file of a beatmap.
+ *
+ * It is named after the hash of the absolute path of the .osu file, so that
+ * the same beatmap always maps to the same cache file.
+ */
+static int cache_path(const char *path, char *cache, size_t size)
+{
+	char dir[PATH_MAX];
+	if (cache_directory(dir, sizeof(dir)) < 0)
+		return -1;
+	char *absolute = realpath(path, NULL);
+	if (!absolute)
+		return -1;
+	uint64_t hash = hash_string(absolute);
+	free(absolute);
+	int rc = snprintf(cache, size, "%s/%016llx.osb", dir, (unsigned long long) hash);
+	if (rc < 0 || (size_t) rc >= size)
+		return -1;
+	return 0;
+}
+
+static size_t align(size_t offset)
+{
+	return (offset + cache_alignment - 1) & ~(cache_alignment - 1);
+}
+
+/* Writing *******************************************************************/
+
+/**
+ * Keep track of the current offset in the cache file being written.
+ */
+struct cache_writer {
+	FILE *file;
+	size_t offset;
+	bool failed;
+};
+
+/**
+ * Append a blob to the file, aligned on #cache_alignment, and return its
+ * offset.
+ *
+ * Errors are recorded in #cache_writer::failed, and checked once at the end.
+ */
+static size_t emit(struct cache_writer *w, const void *data, size_t size)
+{
+	static const char padding[64] = {};
+	static_assert (sizeof(padding) >= alignof(max_align_t), "padding is too small");
+	size_t start = align(w->offset);
+	if (fwrite(padding, 1, start - w->offset, w->file) != start - w->offset)
+		w->failed = true;
+	if (size > 0 && fwrite(data, 1, size, w->file) != size)
+		w->failed = true;
+	w->offset = start + size;
+	return start;
+}
+
+static char* emit_string(struct cache_writer *w, const char *str)
+{
+	if (!str)
+		return NULL;
+	return (char*) (uintptr_t) emit(w, str, strlen(str) + 1);
+}
+
+/**
+ * Find the index of a timing point, plus one.
+ *
+ * Hits are sorted, and so are their timing points, so the search resumes from
+ * the previous result in *cursor*.
+ */
+static uintptr_t timing_point_index(struct oshu_beatmap *beatmap, struct oshu_timing_point *timing, struct oshu_timing_point **cursor, uintptr_t *index)
+{
+	if (!timing)
+		return 0;
+	if (!*cursor) {
+		*cursor = beatmap->timing_points;
+		*index = 1;
+	}
+	for (int pass = 0; pass < 2; ++pass) {
+		for (; *cursor; *cursor = (*cursor)->next, ++*index) {
+			if (*cursor == timing)
+				return *index;
+		}
+		*cursor = beatmap->timing_points;
+		*index = 1;
+	}
+	assert (false);
+	return 0;
+}
+
+static uintptr_t color_index(struct oshu_beatmap *beatmap, struct oshu_color *color)
+{
+	if (!color)
+		return 0;
+	struct oshu_color *c = beatmap->colors;
+	for (uintptr_t i = 1; i <= (uintptr_t) beatmap->color_count; ++i, c = c->next) {
+		if (c == color)
+			return i;
+	}
+	assert (false);
+	return 0;
+}
+
+/**
+ * Write the hits, after their slider blobs.
+ */
+static void emit_hits(struct cache_writer *w, struct oshu_beatmap *beatmap, struct cache_header *header)
+{
+	int count = beatmap->table.size;
+	struct oshu_hit *hits = (oshu_hit*) calloc(count, sizeof(*hits));
+	assert (hits != NULL);
+	struct oshu_timing_point *cursor = NULL;
+	uintptr_t cursor_index = 0;
+	int i = 0;
+	for (struct oshu_hit *hit = beatmap->hits; hit; hit = hit->next, ++i) {
+		assert (i < count);
+		struct oshu_hit *h = &hits[i];
+		*h = *hit;
+		h->previous = h->next = NULL;
+		h->texture = NULL;
+		h->state = OSHU_INITIAL_HIT;
+		h->offset = 0;
+		h->timing_point = (oshu_timing_point*) timing_point_index(beatmap, hit->timing_point, &cursor, &cursor_index);
+		h->color = (oshu_color*) color_index(beatmap, hit->color);
+		if (!(hit->type & OSHU_SLIDER_HIT))
+			continue;
+		struct oshu_slider *slider = &h->slider;
+		if (slider->sounds)
+			slider->sounds = (oshu_hit_sound*) (uintptr_t) emit(w, slider->sounds, (slider->repeat + 1) * sizeof(*slider->sounds));
+		if (slider->path.type == OSHU_BEZIER_PATH) {
+			struct oshu_bezier *bezier = &slider->path.bezier;
+			int points = bezier->indices[bezier->segment_count];
+			bezier->control_points = (oshu_point*) (uintptr_t) emit(w, bezier->control_points, points * sizeof(*bezier->control_points));
+			bezier->indices = (int*) (uintptr_t) emit(w, bezier->indices, (bezier->segment_count + 1) * sizeof(*bezier->indices));
+		}
+	}
+	header->hits_offset = emit(w, hits, count * sizeof(*hits));
+	header->hit_count = count;
+	free(hits);
+}
+
+static void emit_timing_points(struct cache_writer *w, struct oshu_beatmap *beatmap, struct cache_header *header)
+{
+	int count = 0;
+	for (struct oshu_timing_point *t = beatmap->timing_points; t; t = t->next)
+		++count;
+	struct oshu_timing_point *timing_points = (oshu_timing_point*) calloc(count, sizeof(*timing_points));
+	assert (count == 0 || timing_points != NULL);
+	int i = 0;
+	for (struct oshu_timing_point *t = beatmap->timing_points; t; t = t->next, ++i) {
+		timing_points[i] = *t;
+		timing_points[i].next = NULL;
+	}
+	header->timing_points_offset = emit(w, timing_points, count * sizeof(*timing_points));
+	header->timing_point_count = count;
+	free(timing_points);
+}
+
+static void emit_colors(struct cache_writer *w, struct oshu_beatmap *beatmap, struct cache_header *header)
+{
+	int count = beatmap->color_count;
+	struct oshu_color *colors = (oshu_color*) calloc(count, sizeof(*colors));
+	assert (count == 0 || colors != NULL);
+	struct oshu_color *c = beatmap->colors;
+	for (int i = 0; i < count; ++i, c = c->next) {
+		colors[i] = *c;
+		colors[i].next = NULL;
+	}
+	header->colors_offset = emit(w, colors, count * sizeof(*colors));
+	free(colors);
+}
+
+static void emit_strings(struct cache_writer *w, struct oshu_beatmap *beatmap)
+{
+	beatmap->audio_filename = emit_string(w, beatmap->audio_filename);
+	beatmap->background_filename = emit_string(w, beatmap->background_filename);
+	struct oshu_metadata *meta = &beatmap->metadata;
+	meta->title = emit_string(w, meta->title);
+	meta->title_unicode = emit_string(w, meta->title_unicode);
+	meta->artist = emit_string(w, meta->artist);
+	meta->artist_unicode = emit_string(w, meta->artist_unicode);
+	meta->creator = emit_string(w, meta->creator);
+	meta->version = emit_string(w, meta->version);
+	meta->source = emit_string(w, meta->source);
+	meta->tags = NULL;
+}
+
+int oshu_save_beatmap_cache(const char *path, struct oshu_beatmap *beatmap)
+{
+	char cache[PATH_MAX];
+	char temp[PATH_MAX + 8];
+	struct stat st;
+	struct cache_header header {};
+	struct cache_writer w {};
+	if (beatmap->table.size == 0) {
+		oshu_log_debug("the beatmap was not fully loaded; not caching it");
+		return -1;
+	}
+	if (stat(path, &st) < 0) {
+		oshu_log_debug("could not stat %s: %s", path, strerror(errno));
+		return -1;
+	}
+	if (cache_path(path, cache, sizeof(cache)) < 0) {
+		oshu_log_debug("could not locate the beatmap cache for %s", path);
+		return -1;
+	}
+	if (create_cache_directory() < 0) {
+		oshu_log_warning("could not create the beatmap cache directory: %s", strerror(errno));
+		return -1;
+	}
+	snprintf(temp, sizeof(temp), "%s.%d", cache, (int) getpid());
+	w.file = fopen(temp, "wb");
+	if (!w.file) {
+		oshu_log_warning("could not create %s: %s", temp, strerror(errno));
+		return -1;
+	}
+	memcpy(header.magic, cache_magic, sizeof(header.magic));
+	header.version = cache_version;
+	header.beatmap_size = sizeof(struct oshu_beatmap);
+	header.hit_size = sizeof(struct oshu_hit);
+	header.timing_point_size = sizeof(struct oshu_timing_point);
+	header.color_size = sizeof(struct oshu_color);
+	header.source_size = st.st_size;
+	header.source_mtime_sec = st.st_mtim.tv_sec;
+	header.source_mtime_nsec = st.st_mtim.tv_nsec;
+	header.beatmap = *beatmap;
+	/* the header is rewritten once complete */
+	emit(&w, &header, sizeof(header));
+	emit_strings(&w, &header.beatmap);
+	emit_timing_points(&w, beatmap, &header);
+	emit_colors(&w, beatmap, &header);
+	emit_hits(&w, beatmap, &header);
+	header.size = w.offset;
+	header.beatmap.timing_points = NULL;
+	header.beatmap.colors = NULL;
+	header.beatmap.hits = NULL;
+	header.beatmap.table = {};
+	header.beatmap.mapping = NULL;
+	header.beatmap.mapping_size = 0;
+	header.beatmap.arena = {};
+	if (fseek(w.file, 0, SEEK_SET) < 0 || fwrite(&header, sizeof(header), 1, w.file) != 1)
+		w.failed = true;
+	if (fclose(w.file) != 0)
+		w.failed = true;
+	if (w.failed || rename(temp, cache) < 0) {
+		oshu_log_warning("could not write the beatmap cache %s", cache);
+		unlink(temp);
+		return -1;
+	}
+	oshu_log_debug("cached %s into %s", path, cache);
+	return 0;
+}
+
+/* Loading *******************************************************************/
+
+/**
+ * Turn an offset back into a pointer inside the mapping, after checking the
+ * *size* bytes it points to are all inside the mapping.
+ *
+ * Return NULL for a null offset, and set *ok* to false if the offset is out of
+ * bounds.
+ */
+static void* unswizzle(struct oshu_beatmap *beatmap, const void *offset, size_t size, bool *ok)
+{
+	uintptr_t o = (uintptr_t) offset;
+	if (!o)
+		return NULL;
+	if (o < sizeof(struct cache_header) || o > beatmap->mapping_size || size > beatmap->mapping_size - o || o % cache_alignment) {
+		*ok = false;
+		return NULL;
+	}
+	return beatmap->mapping + o;
+}
+
+/**
+ * Like #unswizzle, but also make sure the string is terminated inside the
+ * mapping.
+ */
+static char* unswizzle_string(struct oshu_beatmap *beatmap, char *offset, bool *ok)
+{
+	char *str = (char*) unswizzle(beatmap, offset, 1, ok);
+	if (str && !memchr(str, '\0', beatmap->mapping + beatmap->mapping_size - str)) {
+		*ok = false;
+		return NULL;
+	}
+	return str;
+}
+
+static bool check_header(struct cache_header *header, size_t size, struct stat *source)
+{
+	if (memcmp(header->magic, cache_magic, sizeof(header->magic)))
+		return false;
+	if (header->version != cache_version)
+		return false;
+	if (header->beatmap_size != sizeof(struct oshu_beatmap)
+	    || header->hit_size != sizeof(struct oshu_hit)
+	    || header->timing_point_size != sizeof(struct oshu_timing_point)
+	    || header->color_size != sizeof(struct oshu_color))
+		return false;
+	if (header->size != size)
+		return false;
+	if (header->source_size != (uint64_t) source->st_size
+	    || header->source_mtime_sec != source->st_mtim.tv_sec
+	    || header->source_mtime_nsec != source->st_mtim.tv_nsec)
+		return false;
+	if (header->hit_count < 2 || header->timing_point_count < 0)
+		return false;
+	if (header->beatmap.color_count < 1)
+		return false;
+	return true;
+}
+
+/**
+ * Turn the offsets and indices of the hits back into pointers, and link them.
+ */
+static bool relocate_hits(struct oshu_beatmap *beatmap, struct oshu_hit *hits, int count, struct oshu_timing_point *timing_points, int timing_point_count, struct oshu_color *colors)
+{
+	bool ok = true;
+	for (int i = 0; i < count; ++i) {
+		struct oshu_hit *hit = &hits[i];
+		hit->previous = i > 0 ? &hits[i - 1] : NULL;
+		hit->next = i + 1 < count ? &hits[i + 1] : NULL;
+		uintptr_t t = (uintptr_t) hit->timing_point;
+		if (t > (uintptr_t) timing_point_count)
+			return false;
+		hit->timing_point = t ? &timing_points[t - 1] : NULL;
+		uintptr_t c = (uintptr_t) hit->color;
+		if (c > (uintptr_t) beatmap->color_count)
+			return false;
+		hit->color = c ? &colors[c - 1] : NULL;
+		if (!(hit->type & OSHU_SLIDER_HIT))
+			continue;
+		struct oshu_slider *slider = &hit->slider;
+		if (slider->repeat < 0)
+			return false;
+		slider->sounds = (oshu_hit_sound*) unswizzle(beatmap, slider->sounds, (slider->repeat + 1) * sizeof(*slider->sounds), &ok);
+		if (slider->path.type == OSHU_BEZIER_PATH) {
+			struct oshu_bezier *bezier = &slider->path.bezier;
+			if (bezier->segment_count < 1)
+				return false;
+			bezier->indices = (int*) unswizzle(beatmap, bezier->indices, (bezier->segment_count + 1) * sizeof(*bezier->indices), &ok);
+			if (!ok || !bezier->indices)
+				return false;
+			int points = bezier->indices[bezier->segment_count];
+			if (points < 2)
+				return false;
+			bezier->control_points = (oshu_point*) unswizzle(beatmap, bezier->control_points, points * sizeof(*bezier->control_points), &ok);
+			if (!bezier->control_points)
+				return false;
+		}
+		if (!ok)
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Relocate the whole beatmap from the mapping, once the header was validated.
+ */
+static bool relocate(struct oshu_beatmap *beatmap, struct cache_header *header)
+{
+	bool ok = true;
+	beatmap->audio_filename = unswizzle_string(beatmap, beatmap->audio_filename, &ok);
+	beatmap->background_filename = unswizzle_string(beatmap, beatmap->background_filename, &ok);
+	struct oshu_metadata *meta = &beatmap->metadata;
+	meta->title = unswizzle_string(beatmap, meta->title, &ok);
+	meta->title_unicode = unswizzle_string(beatmap, meta->title_unicode, &ok);
+	meta->artist = unswizzle_string(beatmap, meta->artist, &ok);
+	meta->artist_unicode = unswizzle_string(beatmap, meta->artist_unicode, &ok);
+	meta->creator = unswizzle_string(beatmap, meta->creator, &ok);
+	meta->version = unswizzle_string(beatmap, meta->version, &ok);
+	meta->source = unswizzle_string(beatmap, meta->source, &ok);
+	meta->tags = NULL;
+
+	int timing_point_count = header->timing_point_count;
+	struct oshu_timing_point *timing_points = (oshu_timing_point*) unswizzle(beatmap, (void*) (uintptr_t) header->timing_points_offset, timing_point_count * sizeof(*timing_points), &ok);
+	for (int i = 0; i < timing_point_count && ok; ++i)
+		timing_points[i].next = i + 1 < timing_point_count ? &timing_points[i + 1] : NULL;
+	beatmap->timing_points = timing_point_count ? timing_points : NULL;
+
+	int color_count = beatmap->color_count;
+	struct oshu_color *colors = (oshu_color*) unswizzle(beatmap, (void*) (uintptr_t) header->colors_offset, color_count * sizeof(*colors), &ok);
+	for (int i = 0; i < color_count && ok; ++i)
+		colors[i].next = &colors[(i + 1) % color_count];
+	beatmap->colors = colors;
+
+	int hit_count = header->hit_count;
+	struct oshu_hit *hits = (oshu_hit*) unswizzle(beatmap, (void*) (uintptr_t) header->hits_offset, hit_count * sizeof(*hits), &ok);
+	if (!ok || !colors || !hits)
+		return false;
+	if (!relocate_hits(beatmap, hits, hit_count, timing_points, timing_point_count, colors))
+		return false;
+	beatmap->hits = hits;
+	return true;
+}
+
+int oshu_load_beatmap_cache(const char *path, struct oshu_beatmap *beatmap)
+{
+	char cache[PATH_MAX];
+	struct stat source, st;
+	if (stat(path, &source) < 0)
+		return -1;
+	if (cache_path(path, cache, sizeof(cache)) < 0)
+		return -1;
+	int fd = open(cache, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(struct cache_header)) {
+		close(fd);
+		return -1;
+	}
+	size_t size = st.st_size;
+	void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED)
+		return -1;
+	struct cache_header *header = (struct cache_header*) mapping;
+	if (!check_header(header, size, &source)) {
+		oshu_log_debug("ignoring the stale beatmap cache %s", cache);
+		munmap(mapping, size);
+		return -1;
+	}
+	memcpy(beatmap, &header->beatmap, sizeof(*beatmap));
+	beatmap->mapping = (char*) mapping;
+	beatmap->mapping_size = size;
+	beatmap->arena = {};
+	beatmap->table = {};
+	if (!relocate(beatmap, header)) {
+		oshu_log_warning("the beatmap cache %s is corrupted", cache);
+		munmap(mapping, size);
+		memset(beatmap, 0, sizeof(*beatmap));
+		return -1;
+	}
+	oshu_build_hit_table(beatmap);
+	oshu_log_debug("loaded %s from the cache", path);
+	return 0;
+}
+
+int oshu_load_cached_beatmap(const char *path, struct oshu_beatmap *beatmap)
+{
+	if (oshu_load_beatmap_cache(path, beatmap) == 0)
+		return 0;
+	if (oshu_map_beatmap(path, beatmap) < 0)
+		return -1;
+	oshu_save_beatmap_cache(path, beatmap);
+	return 0;
+}
@@ -8,6 +8,8 @@
 
 #include "beatmap/beatmap.h"
 
+#include <algorithm>
+
 double oshu_hit_end_time(struct oshu_hit *hit)
 {
 	if (hit->type & OSHU_SLIDER_HIT)
@@ -23,3 +25,39 @@ oshu_point oshu_end_point(struct oshu_hit *hit)
 	else
 		return hit->p;
 }
+
+void oshu_set_hit_state(struct oshu_hit_table *table, struct oshu_hit *hit, enum oshu_hit_state state)
+{
+	hit->state = state;
+	table->state[hit->index] = state;
+}
+
+void oshu_build_hit_table(struct oshu_beatmap *beatmap)
+{
+	struct oshu_hit_table *table = &beatmap->table;
+	struct oshu_arena *arena = &beatmap->arena;
+	int size = 0;
+	for (struct oshu_hit *hit = beatmap->hits; hit; hit = hit->next)
+		size++;
+	table->size = size;
+	table->time = (double*) oshu_arena_calloc(arena, size, sizeof(*table->time));
+	table->end_time = (double*) oshu_arena_calloc(arena, size, sizeof(*table->end_time));
+	table->max_end_time = (double*) oshu_arena_calloc(arena, size, sizeof(*table->max_end_time));
+	table->x = (float*) oshu_arena_calloc(arena, size, sizeof(*table->x));
+	table->y = (float*) oshu_arena_calloc(arena, size, sizeof(*table->y));
+	table->type = (int*) oshu_arena_calloc(arena, size, sizeof(*table->type));
+	table->state = (oshu_hit_state*) oshu_arena_calloc(arena, size, sizeof(*table->state));
+	table->hits = (oshu_hit**) oshu_arena_calloc(arena, size, sizeof(*table->hits));
+	int i = 0;
+	for (struct oshu_hit *hit = beatmap->hits; hit; hit = hit->next, ++i) {
+		hit->index = i;
+		table->time[i] = hit->time;
+		table->end_time[i] = oshu_hit_end_time(hit);
+		table->max_end_time[i] = i > 0 ? std::max(table->max_end_time[i - 1], table->end_time[i]) : table->end_time[i];
+		table->x[i] = std::real(hit->p);
+		table->y[i] = std::imag(hit->p);
+		table->type[i] = hit->type;
+		table->state[i] = hit->state;
+		table->hits[i] = hit;
+	}
+}
@@ -9,12 +9,17 @@
 #include "./parser.h"
 #include "beatmap/beatmap.h"
 #include "core/log.h"
+#include "core/number.h"
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 /**
  * Every osu beatmap file must begin with this.
@@ -51,6 +56,10 @@ static const struct oshu_beatmap default_beatmap = {
 	.colors = nullptr,
 	.color_count = 0,
 	.hits = nullptr,
+	.table = {},
+	.mapping = nullptr,
+	.mapping_size = 0,
+	.arena = {},
 };
 
 /**
@@ -138,7 +147,7 @@ static int parse_char(struct parser_state *parser, char *c)
 static int parse_int(struct parser_state *parser, int *value)
 {
 	char *end;
-	*value = strtol(parser->input, &end, 10);
+	*value = oshu_strtoi(parser->input, &end);
 	if (end == parser->input) {
 		parser_error(parser, "expected a number");
 		return -1;
@@ -165,7 +174,7 @@ static int parse_int_sep(struct parser_state *parser, int *value, char sep)
 static int parse_double(struct parser_state *parser, double *value)
 {
 	char *end;
-	*value = strtod(parser->input, &end);
+	*value = oshu_strtod(parser->input, &end);
 	if (end == parser->input) {
 		parser_error(parser, "expected a floating number");
 		return -1;
@@ -197,7 +206,8 @@ static int parse_double_sep(struct parser_state *parser, double *value, char sep
  * If the string is empty, `*str` is set to NULL.
  *
  * Otherwise, return a dynamically allocated string using *strdup*, which you
- * must not forget to free!
+ * must not forget to free! In #parser_state::zero_copy mode, the string is not
+ * duplicated and points inside the input instead.
  */
 static int parse_string(struct parser_state *parser, char **str)
 {
@@ -206,7 +216,7 @@ static int parse_string(struct parser_state *parser, char **str)
 		return 0;
 	} else {
 		int len = strlen(parser->input);
-		*str = strdup(parser->input);
+		*str = parser->zero_copy ? parser->input : strdup(parser->input);
 		parser->input += len;
 		return 0;
 	}
@@ -236,7 +246,7 @@ static int parse_quoted_string(struct parser_state *parser, char **str)
 		*str = NULL;
 		return 0;
 	} else {
-		*str = strdup(parser->input);
+		*str = parser->zero_copy ? parser->input : strdup(parser->input);
 		parser->input = end + 1;
 	}
 	return 0;
@@ -246,41 +256,118 @@ static int parse_quoted_string(struct parser_state *parser, char **str)
  * Map each token to its string representation using CPP's magic
  * stringification operator.
  */
-static const char* token_strings[NUM_TOKENS] = {
+static constexpr const char* token_strings[NUM_TOKENS] = {
 #define TOKEN(t) #t,
 #include "./tokens.h"
 #undef TOKEN
 };
 
 /**
- * Perform a dichotomic search using #token_strings.
+ * Number of slots in the token hash table.
  *
- * The *str* argument isn't expected to be null-terminated at *len*, so we must
- * make sure we take the length into account when comparing tokens, and not
- * listen too much to *strncmp* which would return 0 if *str* is a prefix of
- * the candidate token.
+ * It must be a few times larger than #NUM_TOKENS for a perfect hash seed to be
+ * found quickly. If the static assertion on #token_seed ever fails after new
+ * tokens were added, double it.
  */
-static int search_token(const char *str, int len, enum token *token)
+static constexpr int token_table_size = 256;
+
+static_assert (NUM_TOKENS < 128, "tokens must fit in a signed char");
+static_assert (NUM_TOKENS * 4 <= token_table_size, "the token table is too small");
+
+static constexpr int token_length(const char *str)
 {
-	int start = 0;
-	int end = NUM_TOKENS - 1; /* inclusive */
-	while (start <= end) {
-		int middle = start + (end - start) / 2;
-		const char *repr = token_strings[middle];
-		int cmp = strncmp(str, repr, len);
-		if (cmp == 0)
-			cmp = len - strlen(repr);
-		if (cmp == 0) {
-			/* Found! */
-			*token = (enum token) middle;
-			return 0;
-		} else if (cmp < 0) {
-			end = middle - 1;
-		} else {
-			start = middle + 1;
-		}
+	int length = 0;
+	while (str[length])
+		++length;
+	return length;
+}
+
+/**
+ * Seeded 32-bit FNV-1a hash of the *len* first bytes of *str*.
+ */
+static constexpr uint32_t hash_token(const char *str, int len, uint32_t seed)
+{
+	uint32_t hash = seed;
+	for (int i = 0; i < len; ++i)
+		hash = (hash ^ (unsigned char) str[i]) * 16777619u;
+	return hash;
+}
+
+/**
+ * Tell whether a seed makes #hash_token a perfect hash over the tokens, that
+ * is if no two tokens land on the same slot.
+ */
+static constexpr bool perfect_seed(uint32_t seed)
+{
+	bool used[token_table_size] = {};
+	for (int t = 0; t < NUM_TOKENS; ++t) {
+		uint32_t slot = hash_token(token_strings[t], token_length(token_strings[t]), seed) % token_table_size;
+		if (used[slot])
+			return false;
+		used[slot] = true;
 	}
-	return -1;
+	return true;
+}
+
+static constexpr uint32_t find_token_seed()
+{
+	for (uint32_t seed = 1; seed < 4096; ++seed) {
+		if (perfect_seed(seed))
+			return seed;
+	}
+	return 0;
+}
+
+/**
+ * The first seed that yields a perfect hash, found at compile time.
+ */
+static constexpr uint32_t token_seed = find_token_seed();
+static_assert (token_seed != 0, "no perfect hash seed found for the tokens");
+
+/**
+ * Perfect hash table of the tokens, computed at compile time from *tokens.h*.
+ *
+ * Each slot contains the token whose hash is the slot index, along with its
+ * length, or -1 if no token hashes there.
+ */
+struct token_table {
+	signed char tokens[token_table_size];
+	unsigned char lengths[token_table_size];
+};
+
+static constexpr struct token_table build_token_table()
+{
+	struct token_table table {};
+	for (int i = 0; i < token_table_size; ++i)
+		table.tokens[i] = -1;
+	for (int t = 0; t < NUM_TOKENS; ++t) {
+		int length = token_length(token_strings[t]);
+		uint32_t slot = hash_token(token_strings[t], length, token_seed) % token_table_size;
+		table.tokens[slot] = t;
+		table.lengths[slot] = length;
+	}
+	return table;
+}
+
+static constexpr struct token_table token_table = build_token_table();
+
+/**
+ * Look a token up in the #token_table.
+ *
+ * The *str* argument isn't expected to be null-terminated at *len*. Since the
+ * hash is perfect, a single comparison tells whether we've got the token or
+ * not.
+ */
+static int search_token(const char *str, int len, enum token *token)
+{
+	uint32_t slot = hash_token(str, len, token_seed) % token_table_size;
+	int candidate = token_table.tokens[slot];
+	if (candidate < 0 || token_table.lengths[slot] != len)
+		return -1;
+	if (memcmp(str, token_strings[candidate], len))
+		return -1;
+	*token = (enum token) candidate;
+	return 0;
 }
 
 static int parse_token(struct parser_state *parser, enum token *token)
@@ -609,7 +696,6 @@ static int process_timing_point(struct parser_state *parser)
 		return -1;
 	if (parser->last_timing_point && timing->offset < parser->last_timing_point->offset) {
 		parser_error(parser, "misordered timing point");
-		free(timing);
 		return -1;
 	}
 	/* link it to the timing points list */
@@ -624,8 +710,7 @@ static int process_timing_point(struct parser_state *parser)
 static int parse_timing_point(struct parser_state *parser, struct oshu_timing_point **timing)
 {
 	int value;
-	*timing = (oshu_timing_point*) calloc(1, sizeof(**timing));
-	assert (timing != NULL);
+	*timing = (oshu_timing_point*) oshu_arena_calloc(&parser->beatmap->arena, 1, sizeof(**timing));
 	/* 1. Timing offset. */
 	if (parse_double_sep(parser, &(*timing)->offset, ',') < 0)
 		goto fail;
@@ -677,7 +762,6 @@ static int parse_timing_point(struct parser_state *parser, struct oshu_timing_po
 		goto fail;
 	return 0;
 fail:
-	free(*timing);
 	*timing = NULL;
 	return -1;
 }
@@ -745,8 +829,7 @@ static int process_color_combo(struct parser_state *parser)
 
 static int parse_color(struct parser_state *parser, struct oshu_color **color)
 {
-	*color = (oshu_color*) calloc(1, sizeof(**color));
-	assert (color != NULL);
+	*color = (oshu_color*) oshu_arena_calloc(&parser->beatmap->arena, 1, sizeof(**color));
 	if (parse_color_channel(parser, &(*color)->red) < 0)
 		goto fail;
 	if (consume_char(parser, ',') < 0)
@@ -759,7 +842,6 @@ static int parse_color(struct parser_state *parser, struct oshu_color **color)
 		goto fail;
 	return 0;
 fail:
-	free(*color);
 	*color = NULL;
 	return -1;
 }
@@ -782,7 +864,7 @@ static void validate_colors(struct parser_state *parser)
 	if (parser->beatmap->colors)
 		return;
 	oshu_log_debug("no colors; generating a default color scheme");
-	oshu_color *color = (oshu_color*) calloc(1, sizeof(*color));
+	oshu_color *color = (oshu_color*) oshu_arena_calloc(&parser->beatmap->arena, 1, sizeof(*color));
 	color->red = color->green = color->blue = 128;
 	color->next = color;
 	parser->beatmap->colors = color;
@@ -882,7 +964,6 @@ static int process_hit_object(struct parser_state *parser)
 	assert (parser->last_hit != NULL);
 	if (hit->time < parser->last_hit->time) {
 		parser_error(parser, "missorted hit object");
-		free(hit);
 		return -1;
 	}
 	parser->last_hit->next = hit;
@@ -894,16 +975,15 @@ static int process_hit_object(struct parser_state *parser)
 /**
  * Allocate and parse one hit object.
  *
- * On failure, return -1, free any allocated memory, and leave `*hit`
- * unspecified.
+ * On failure, return -1 and leave `*hit` unspecified. The memory allocated
+ * for the hit stays in the beatmap's arena until the beatmap is destroyed.
  *
  * Consumes:
  * `288,256,8538,2,0,P|254:261|219:255,1,70,8|0,0:0|0:0,0:0:0:0:`
  */
 static int parse_hit_object(struct parser_state *parser, struct oshu_hit **hit)
 {
-	*hit = (oshu_hit*) calloc(1, sizeof(**hit));
-	assert (*hit != NULL);
+	*hit = (oshu_hit*) oshu_arena_calloc(&parser->beatmap->arena, 1, sizeof(**hit));
 	if (parse_common_hit(parser, *hit) < 0)
 		goto fail;
 	(*hit)->timing_point = seek_timing_point((*hit)->time, parser);
@@ -934,7 +1014,6 @@ static int parse_hit_object(struct parser_state *parser, struct oshu_hit **hit)
 		fill_slider_additions(*hit);
 	return 0;
 fail:
-	free(*hit);
 	*hit = NULL;
 	return -1;
 }
@@ -1002,7 +1081,7 @@ static int parse_slider(struct parser_state *parser, struct oshu_hit *hit)
 	if (parse_double(parser, &hit->slider.length) < 0)
 		return -1;
 	hit->slider.duration = hit->slider.length / (100. * parser->beatmap->difficulty.slider_multiplier) * hit->timing_point->beat_duration;
-	oshu_normalize_path(&hit->slider.path, hit->slider.length);
+	oshu_normalize_path(&hit->slider.path, hit->slider.length, &parser->beatmap->arena);
 	if (parse_slider_additions(parser, hit) < 0)
 		return -1;
 	return 0;
@@ -1102,13 +1181,11 @@ static int parse_bezier_slider(struct parser_state *parser, struct oshu_hit *hit
 
 	hit->slider.path.type = OSHU_BEZIER_PATH;
 	struct oshu_bezier *bezier = &hit->slider.path.bezier;
-	bezier->control_points = (oshu_point*) calloc(count, sizeof(*bezier->control_points));
-	assert (bezier->control_points != NULL);
+	bezier->control_points = (oshu_point*) oshu_arena_calloc(&parser->beatmap->arena, count, sizeof(*bezier->control_points));
 	bezier->control_points[0] = hit->p;
 
 	int index = 0;
-	bezier->indices = (int*) calloc(count, sizeof(*bezier->indices));
-	assert (bezier->indices != NULL);
+	bezier->indices = (int*) oshu_arena_calloc(&parser->beatmap->arena, count, sizeof(*bezier->indices));
 	bezier->indices[index] = 0;
 
 	oshu_point prev = bezier->control_points[0];
@@ -1127,9 +1204,7 @@ static int parse_bezier_slider(struct parser_state *parser, struct oshu_hit *hit
 	bezier->segment_count = index;
 	return 0;
 fail:
-	free(bezier->control_points);
 	bezier->control_points = NULL;
-	free(bezier->indices);
 	bezier->indices = NULL;
 	return -1;
 }
@@ -1143,8 +1218,7 @@ fail:
  */
 static int parse_slider_additions(struct parser_state *parser, struct oshu_hit *hit)
 {
-	hit->slider.sounds = (oshu_hit_sound*) calloc(hit->slider.repeat + 1, sizeof(*hit->slider.sounds));
-	assert (hit->slider.sounds != NULL);
+	hit->slider.sounds = (oshu_hit_sound*) oshu_arena_calloc(&parser->beatmap->arena, hit->slider.repeat + 1, sizeof(*hit->slider.sounds));
 	/* Degenerate case. */
 	if (*parser->input == '\0')
 		return 0;
@@ -1176,7 +1250,6 @@ static int parse_slider_additions(struct parser_state *parser, struct oshu_hit *
 	}
 	return 0;
 fail:
-	free(hit->slider.sounds);
 	hit->slider.sounds = NULL;
 	return -1;
 }
@@ -1277,51 +1350,114 @@ static int parse_additions(struct parser_state *parser, struct oshu_hit *hit)
 /* Global interface **********************************************************/
 
 /**
- * Create the parser state, then read the input file line-by-line, feeding it
- * to the parser automaton with #process_input.
+ * Initialize the parser state for a beatmap.
+ */
+static void start_parsing(struct parser_state *parser, const char *name, struct oshu_beatmap *beatmap)
+{
+	memset(parser, 0, sizeof(*parser));
+	parser->section = BEATMAP_HEADER;
+	parser->source = name;
+	parser->beatmap = beatmap;
+	parser->last_hit = beatmap->hits;
+}
+
+/**
+ * Trim a line and feed it to the parser automaton with #process_input.
+ *
+ * The line must be null-terminated at *length*.
+ *
+ * Return 0 when the parser is ready for the next line, 1 when it doesn't need
+ * to read any further, and -1 when the file must be rejected.
  *
  * \todo
  * Stop reading the file if the header is incorrect. It's no use printing a
  * mega list of warnings if the file clearly looks nothing like text.
  */
+static int parse_line(struct parser_state *parser, char *line, size_t length, bool headers_only)
+{
+	for (size_t i = length; i > 0 && isspace(line[i - 1]); --i)
+		line[i - 1] = '\0';
+	parser->buffer = line;
+	parser->input = line;
+	parser->line_number++;
+	try {
+		process_input(parser);
+	} catch (invalid_header& e) {
+		oshu::log::error() << e.what() << std::endl;
+		return -1;
+	}
+	/* ^ note: ignore parsing errors */
+	if (headers_only && parser->section == BEATMAP_TIMING_POINTS)
+		return 1;
+	return 0;
+}
+
+/**
+ * Close the hits sequence with the final unreachable hit, and build the hit
+ * table.
+ */
+static void finish_parsing(struct parser_state *parser)
+{
+	struct oshu_hit *end;
+	end = (oshu_hit*) oshu_arena_calloc(&parser->beatmap->arena, 1, sizeof(*end));
+	end->time = INFINITY;
+	parser->last_hit->next = end;
+	end->previous = parser->last_hit;
+	oshu_build_hit_table(parser->beatmap);
+}
+
+/**
+ * Create the parser state, then read the input file line-by-line, feeding it
+ * to the parser automaton with #parse_line.
+ */
 static int parse_file(FILE *input, const char *name, struct oshu_beatmap *beatmap, bool headers_only)
 {
 	struct parser_state parser;
-	memset(&parser, 0, sizeof(parser));
-	parser.section = BEATMAP_HEADER;
-	parser.source = name;
-	parser.beatmap = beatmap;
-	parser.last_hit = beatmap->hits;
+	start_parsing(&parser, name, beatmap);
 	int rc = 0;
 	char *line = NULL;
 	size_t len = 0;
 	ssize_t nread;
 	while ((nread = getline(&line, &len, input)) != -1) {
-		for (int i = nread - 1; i >= 0 && isspace(line[i]); --i)
-			line[i] = '\0';
-		parser.buffer = line;
-		parser.input = line;
-		parser.line_number++;
-		try {
-			process_input(&parser);
-		} catch (invalid_header& e) {
-			oshu::log::error() << e.what() << std::endl;
-			rc = -1;
-			break;
-		}
-		/* ^ note: ignore parsing errors */
-		if (headers_only && parser.section == BEATMAP_TIMING_POINTS)
+		rc = parse_line(&parser, line, nread, headers_only);
+		if (rc != 0)
 			break;
 	}
 	free(line);
-	/* Finalize the hits sequence. */
-	struct oshu_hit *end;
-	end = (oshu_hit*) calloc(1, sizeof(*end));
-	assert (end != NULL);
-	end->time = INFINITY;
-	parser.last_hit->next = end;
-	end->previous = parser.last_hit;
-	return rc;
+	finish_parsing(&parser);
+	return rc < 0 ? -1 : 0;
+}
+
+/**
+ * Parse the beatmap's #oshu_beatmap::mapping in place.
+ *
+ * Each line break is replaced by a null byte, which lets the parser work on
+ * the mapped lines directly without copying them, and lets the parsed strings
+ * point inside the mapping.
+ *
+ * The last byte of the mapping is expected to be past the end of the file, so
+ * that the final line can be terminated even without a trailing line break.
+ */
+static int parse_mapping(const char *name, struct oshu_beatmap *beatmap, bool headers_only)
+{
+	struct parser_state parser;
+	start_parsing(&parser, name, beatmap);
+	parser.zero_copy = true;
+	int rc = 0;
+	char *cursor = beatmap->mapping;
+	char *end = beatmap->mapping + beatmap->mapping_size - 1;
+	while (cursor < end) {
+		char *eol = (char*) memchr(cursor, '\n', end - cursor);
+		if (!eol)
+			eol = end;
+		*eol = '\0';
+		rc = parse_line(&parser, cursor, eol - cursor, headers_only);
+		if (rc != 0)
+			break;
+		cursor = eol + 1;
+	}
+	finish_parsing(&parser);
+	return rc < 0 ? -1 : 0;
 }
 
 /**
@@ -1331,8 +1467,7 @@ static int parse_file(FILE *input, const char *name, struct oshu_beatmap *beatma
 void initialize(struct oshu_beatmap *beatmap)
 {
 	memcpy(beatmap, &default_beatmap, sizeof(*beatmap));
-	beatmap->hits = (oshu_hit*) calloc(1, sizeof(*beatmap->hits));
-	assert (beatmap->hits != NULL);
+	beatmap->hits = (oshu_hit*) oshu_arena_calloc(&beatmap->arena, 1, sizeof(*beatmap->hits));
 	beatmap->hits->time = -INFINITY;
 }
 
@@ -1364,8 +1499,69 @@ static int validate(struct oshu_beatmap *beatmap)
 	return 0;
 }
 
-static int load_beatmap(const char *path, struct oshu_beatmap *beatmap, bool headers_only)
+/**
+ * Map a whole beatmap file in memory, into #oshu_beatmap::mapping.
+ *
+ * The mapping is private and writable, so that the parser can tokenize it in
+ * place without affecting the file.
+ *
+ * It is one byte longer than the file, to make room for a final null byte.
+ * When the size of the file is a multiple of the page size, that extra byte
+ * would fall outside the file and accessing it would raise SIGBUS. To avoid
+ * that, the whole range is first reserved with an anonymous mapping, and the
+ * file is then mapped on top of it.
+ */
+static int map_file(int fd, size_t size, struct oshu_beatmap *beatmap)
+{
+	size_t length = size + 1;
+	void *mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mapping == MAP_FAILED) {
+		oshu_log_error("could not allocate memory for the beatmap: %s", strerror(errno));
+		return -1;
+	}
+	if (size > 0 && mmap(mapping, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		oshu_log_error("could not map the beatmap: %s", strerror(errno));
+		munmap(mapping, length);
+		return -1;
+	}
+	beatmap->mapping = (char*) mapping;
+	beatmap->mapping_size = length;
+	return 0;
+}
 
+static int read_beatmap(const char *path, struct oshu_beatmap *beatmap, bool headers_only)
+{
+	FILE *input = fopen(path, "r");
+	if (input == NULL) {
+		oshu_log_error("could not open the beatmap: %s", strerror(errno));
+		return -1;
+	}
+	int rc = parse_file(input, path, beatmap, headers_only);
+	fclose(input);
+	return rc;
+}
+
+static int map_beatmap(const char *path, struct oshu_beatmap *beatmap, bool headers_only)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		oshu_log_error("could not open the beatmap: %s", strerror(errno));
+		return -1;
+	}
+	struct stat s;
+	if (fstat(fd, &s) < 0) {
+		oshu_log_error("could not stat the beatmap: %s", strerror(errno));
+		close(fd);
+		return -1;
+	}
+	int rc = map_file(fd, s.st_size, beatmap);
+	close(fd);
+	if (rc < 0)
+		return -1;
+	return parse_mapping(path, beatmap, headers_only);
+}
+
+static int load_beatmap(const char *path, struct oshu_beatmap *beatmap, bool headers_only, bool mapped)
 {
 	oshu_log_debug("loading beatmap %s", path);
 	struct stat s;
@@ -1377,14 +1573,12 @@ static int load_beatmap(const char *path, struct oshu_beatmap *beatmap, bool hea
 		oshu_log_error("not a file: %s", path);
 		return -1;
 	}
-	FILE *input = fopen(path, "r");
-	if (input == NULL) {
-		oshu_log_error("could not open the beatmap: %s", strerror(errno));
-		return -1;
-	}
 	initialize(beatmap);
-	int rc = parse_file(input, path, beatmap, headers_only);
-	fclose(input);
+	int rc;
+	if (mapped)
+		rc = map_beatmap(path, beatmap, headers_only);
+	else
+		rc = read_beatmap(path, beatmap, headers_only);
 	if (rc < 0)
 		goto fail;
 	if (validate(beatmap) < 0)
@@ -1398,76 +1592,187 @@ fail:
 
 int oshu_load_beatmap(const char *path, struct oshu_beatmap *beatmap)
 {
-	return load_beatmap(path, beatmap, false);
+	return load_beatmap(path, beatmap, false, false);
 }
 
 int oshu_load_beatmap_headers(const char *path, struct oshu_beatmap *beatmap)
 {
-	return load_beatmap(path, beatmap, true);
+	return load_beatmap(path, beatmap, true, false);
 }
 
-static void free_metadata(struct oshu_metadata *meta)
+int oshu_map_beatmap(const char *path, struct oshu_beatmap *beatmap)
 {
-	free(meta->title);
-	free(meta->title_unicode);
-	free(meta->artist);
-	free(meta->artist_unicode);
-	free(meta->creator);
-	free(meta->version);
-	free(meta->source);
+	return load_beatmap(path, beatmap, false, true);
+}
+
+/**
+ * Size of the buffer used by #oshu_scan_beatmap, and also the size of the
+ * longest line it can parse.
+ */
+static const size_t scan_buffer_size = 8192;
+
+/**
+ * Move a string borrowed from the scanning buffer into the info record, and
+ * forget it.
+ */
+static void harvest_string(char **str, char *dest, size_t size)
+{
+	if (!*str)
+		return;
+	size_t length = strnlen(*str, size - 1);
+	memcpy(dest, *str, length);
+	dest[length] = '\0';
+	*str = NULL;
 }
 
-static void free_path(struct oshu_path *path)
+/**
+ * Copy the strings the last line set in the scratch beatmap, before the
+ * buffer they point to is overwritten.
+ */
+static void harvest_strings(struct oshu_beatmap *scratch, struct oshu_beatmap_info *info)
 {
-	if (path->type == OSHU_BEZIER_PATH) {
-		free(path->bezier.control_points);
-		free(path->bezier.indices);
+	struct oshu_metadata *meta = &scratch->metadata;
+	harvest_string(&scratch->audio_filename, info->audio_filename, sizeof(info->audio_filename));
+	harvest_string(&meta->title, info->title, sizeof(info->title));
+	harvest_string(&meta->title_unicode, info->title_unicode, sizeof(info->title_unicode));
+	harvest_string(&meta->artist, info->artist, sizeof(info->artist));
+	harvest_string(&meta->artist_unicode, info->artist_unicode, sizeof(info->artist_unicode));
+	harvest_string(&meta->creator, info->creator, sizeof(info->creator));
+	harvest_string(&meta->version, info->difficulty_name, sizeof(info->difficulty_name));
+	harvest_string(&meta->source, info->source, sizeof(info->source));
+	scratch->background_filename = NULL;
+}
+
+/**
+ * Tell whether all the sections #oshu_scan_beatmap is interested in are
+ * behind.
+ */
+static bool past_headers(enum beatmap_section section)
+{
+	switch (section) {
+	case BEATMAP_EVENTS:
+	case BEATMAP_TIMING_POINTS:
+	case BEATMAP_COLOURS:
+	case BEATMAP_HIT_OBJECTS:
+		return true;
+	default:
+		return false;
 	}
 }
 
-static void free_hits(struct oshu_hit *hits)
+/**
+ * Read the file chunk by chunk, and feed every complete line to the parser.
+ *
+ * The parser works on a scratch beatmap in zero-copy mode, without any hit
+ * list. Its strings point inside the buffer, so they're harvested after every
+ * line.
+ *
+ * Return 0 once the headers are read, even when the end of the file isn't
+ * reached, and -1 on error.
+ */
+static int scan_file(int fd, const char *name, struct oshu_beatmap *scratch, struct oshu_beatmap_info *info)
 {
-	struct oshu_hit *current = hits;
-	while (current != NULL) {
-		struct oshu_hit *next = current->next;
-		if (current->type & OSHU_SLIDER_HIT) {
-			free_path(&current->slider.path);
-			free(current->slider.sounds);
+	struct parser_state parser;
+	start_parsing(&parser, name, scratch);
+	parser.zero_copy = true;
+	char buffer[scan_buffer_size + 1];
+	size_t filled = 0;
+	bool skipping = false;
+	for (;;) {
+		ssize_t rc = read(fd, buffer + filled, scan_buffer_size - filled);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc < 0) {
+			oshu_log_error("could not read %s: %s", name, strerror(errno));
+			return -1;
+		}
+		bool eof = rc == 0;
+		char *end = buffer + filled + rc;
+		char *line = buffer;
+		while (line < end) {
+			char *eol = (char*) memchr(line, '\n', end - line);
+			if (!eol && !eof)
+				break;
+			else if (!eol)
+				eol = end; /* there's always room for the null byte */
+			*eol = '\0';
+			if (skipping) {
+				skipping = false;
+				parser.line_number++;
+			} else {
+				int status = parse_line(&parser, line, eol - line, false);
+				harvest_strings(scratch, info);
+				if (status < 0)
+					return -1;
+			}
+			if (past_headers(parser.section))
+				return 0;
+			line = eol + 1;
 		}
-		free(current);
-		current = next;
+		if (eof)
+			return 0;
+		filled = end > line ? end - line : 0;
+		if (filled == scan_buffer_size) {
+			oshu_log_debug("%s:%d: skipping an overlong line", name, parser.line_number + 1);
+			skipping = true;
+			filled = 0;
+		}
+		memmove(buffer, line, filled);
 	}
 }
 
-static void free_timing_points(struct oshu_timing_point *t)
+int oshu_scan_beatmap(const char *path, struct oshu_beatmap_info *info)
 {
-	struct oshu_timing_point *current = t;
-	while (current != NULL) {
-		struct oshu_timing_point *next = current->next;
-		free(current);
-		current = next;
+	oshu_log_debug("scanning beatmap %s", path);
+	memset(info, 0, sizeof(*info));
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		oshu_log_error("could not open the beatmap: %s", strerror(errno));
+		return -1;
 	}
+	struct oshu_beatmap scratch;
+	memcpy(&scratch, &default_beatmap, sizeof(scratch));
+	int rc = scan_file(fd, path, &scratch, info);
+	close(fd);
+	if (rc < 0)
+		return -1;
+	info->version = scratch.version;
+	info->mode = scratch.mode;
+	info->beatmap_id = scratch.metadata.beatmap_id;
+	info->beatmap_set_id = scratch.metadata.beatmap_set_id;
+	info->difficulty = scratch.difficulty;
+	if (!*info->audio_filename) {
+		oshu_log_error("no audio file mentionned in %s", path);
+		return -1;
+	}
+	if (!*info->title || !*info->artist || !*info->difficulty_name) {
+		oshu_log_error("incomplete metadata in %s", path);
+		return -1;
+	}
+	return 0;
 }
 
-static void free_colors(struct oshu_color *colors)
+static void free_metadata(struct oshu_metadata *meta)
 {
-	if (!colors)
-		return;
-	struct oshu_color *current = colors;
-	do {
-		struct oshu_color *next = current->next;
-		free(current);
-		current = next;
-	} while (current != colors);
+	free(meta->title);
+	free(meta->title_unicode);
+	free(meta->artist);
+	free(meta->artist_unicode);
+	free(meta->creator);
+	free(meta->version);
+	free(meta->source);
 }
 
 void oshu_destroy_beatmap(struct oshu_beatmap *beatmap)
 {
-	free(beatmap->audio_filename);
-	free(beatmap->background_filename);
-	free_metadata(&beatmap->metadata);
-	free_timing_points(beatmap->timing_points);
-	free_colors(beatmap->colors);
-	free_hits(beatmap->hits);
+	if (beatmap->mapping) {
+		/* the strings were borrowed from the mapping */
+		munmap(beatmap->mapping, beatmap->mapping_size);
+	} else {
+		free(beatmap->audio_filename);
+		free(beatmap->background_filename);
+		free_metadata(&beatmap->metadata);
+	}
+	oshu_arena_free(&beatmap->arena);
 	memset(beatmap, 0, sizeof(*beatmap));
 }
@@ -77,8 +77,8 @@
  * Enumerate all the special strings that may be found in a header file.
  *
  * Using such a structure makes it easier, and also faster, to branch on
- * sections or keys. The #parse_token function also optimizes the performance
- * by performing a dichotomic search.
+ * sections or keys. The #parse_token function looks them up in a perfect hash
+ * table computed at compile time.
  *
  * Since we're in an internal header, let's break the naming a bit and use the
  * same strings as the ones in the beatmap, with the same case.
@@ -162,6 +162,12 @@ struct parser_state {
 	 * Its memory isn't handled by us.
 	 */
 	struct oshu_beatmap *beatmap;
+	/**
+	 * When true, the input lines live inside #oshu_beatmap::mapping, and
+	 * outlive the parser. Parsed strings then point straight into the
+	 * input instead of being duplicated.
+	 */
+	bool zero_copy;
 	/**
 	 * The current section.
 	 *
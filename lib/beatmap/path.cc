@@ -150,10 +150,11 @@ static oshu_point bezier_at(struct oshu_bezier *path, double t)
  * equal to the *extension* argument, and finally adding that vector to the
  * previous point.
  *
- * The memory reallocation implies the memory must have been dynamically
- * allocated. You won't be able to grow a static path.
+ * The dynamic arrays are reallocated from the arena, which implies they must
+ * have been allocated from it in the first place. You won't be able to grow a
+ * static path.
  */
-static int grow_bezier(struct oshu_bezier *bezier, double extension)
+static int grow_bezier(struct oshu_bezier *bezier, double extension, struct oshu_arena *arena)
 {
 	assert (bezier->segment_count >= 1);
 	assert (bezier->indices != NULL);
@@ -170,11 +171,19 @@ static int grow_bezier(struct oshu_bezier *bezier, double extension)
 		return -1;
 	}
 
+	bezier->indices = (int*) oshu_arena_realloc(
+		arena, bezier->indices,
+		(bezier->segment_count + 1) * sizeof(*bezier->indices),
+		(bezier->segment_count + 2) * sizeof(*bezier->indices)
+	);
 	bezier->segment_count++;
-	bezier->indices = (int*) realloc(bezier->indices, (bezier->segment_count + 1) * sizeof(*bezier->indices));
 	bezier->indices[bezier->segment_count] = n + 2;
 
-	bezier->control_points = (oshu_point*) realloc(bezier->control_points, (n + 2) * sizeof(*bezier->control_points));
+	bezier->control_points = (oshu_point*) oshu_arena_realloc(
+		arena, bezier->control_points,
+		n * sizeof(*bezier->control_points),
+		(n + 2) * sizeof(*bezier->control_points)
+	);
 	bezier->control_points[n] = end;
 	bezier->control_points[n + 1] = end + direction / std::abs(direction) * extension;
 	return 0;
@@ -211,7 +220,7 @@ static int grow_bezier(struct oshu_bezier *bezier, double extension)
  *    Finally, let `anchors[j] = (1-k) * t_i + k * t_(i+1)`.
  *
  */
-void normalize_bezier(struct oshu_bezier *bezier, double target_length)
+void normalize_bezier(struct oshu_bezier *bezier, double target_length, struct oshu_arena *arena)
 {
 	/* 1. Prepare the field. */
 	int n = 64;  /* arbitrary */
@@ -230,7 +239,7 @@ begin:
 		prev = current;
 	}
 	if (length + 5. < target_length) {
-		if (grow_bezier(bezier, target_length - length) >= 0)
+		if (grow_bezier(bezier, target_length - length, arena) >= 0)
 			goto begin;
 	}
 	if (length < target_length)
@@ -408,7 +417,7 @@ void arc_bounding_box(struct oshu_arc *arc, oshu_point *top_left, oshu_point *bo
 
 /* Generic interface **********************************************************/
 
-void oshu_normalize_path(struct oshu_path *path, double length)
+void oshu_normalize_path(struct oshu_path *path, double length, struct oshu_arena *arena)
 {
 	switch (path->type) {
 	case OSHU_LINEAR_PATH:
@@ -416,7 +425,7 @@ void oshu_normalize_path(struct oshu_path *path, double length)
 	case OSHU_PERFECT_PATH:
 		return normalize_arc(&path->arc, length);
 	case OSHU_BEZIER_PATH:
-		return normalize_bezier(&path->bezier, length);
+		return normalize_bezier(&path->bezier, length, arena);
 	default:
 		return;
 	}
@@ -8,9 +8,9 @@
  * This file is a bit magical as it uses a special `TOKEN` macro defined by the
  * file that includes *tokens.h*.
  *
- * It is an absolute requirement that the tokens are sorted in alphabetical order!
- * This lets us perform a dichotomic search when parsing, which makes lexing
- * orders of magnitude faster.
+ * The parser builds a perfect hash table from this list at compile time, so
+ * looking a token up costs one hash and one comparison. The order doesn't
+ * matter for the lookup, but keep the tokens sorted for readability.
  */
 
 TOKEN(ApproachRate)
@@ -0,0 +1,97 @@
+/**
+ * \file lib/core/arena.cc
+ * \ingroup core_arena
+ */
+
+#include "core/arena.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Size of the first chunk of an arena.
+ *
+ * A typical beatmap needs a few hundreds of kilobytes.
+ */
+static const size_t initial_chunk_size = 64 * 1024;
+
+/**
+ * Stop growing the chunks past this size, so that the memory wasted at the
+ * end of the last chunk stays reasonable.
+ */
+static const size_t max_chunk_size = 4 * 1024 * 1024;
+
+/**
+ * Every allocation is aligned on this boundary, like *malloc* does.
+ */
+static const size_t alignment = alignof(max_align_t);
+
+/**
+ * A chunk is a header followed by its *capacity* bytes of data.
+ */
+struct oshu_arena_chunk {
+	struct oshu_arena_chunk *previous;
+	size_t capacity;
+	size_t used;
+	alignas(max_align_t) char data[];
+};
+
+static size_t align(size_t size)
+{
+	return (size + alignment - 1) & ~(alignment - 1);
+}
+
+/**
+ * Push a new chunk big enough to hold *size* bytes.
+ *
+ * Chunks are allocated with *calloc*, which gives us zeroed memory for free,
+ * and usually maps fresh pages for big chunks.
+ */
+static struct oshu_arena_chunk* new_chunk(struct oshu_arena *arena, size_t size)
+{
+	size_t capacity = arena->next_size ? arena->next_size : initial_chunk_size;
+	if (capacity < size)
+		capacity = size;
+	struct oshu_arena_chunk *chunk = (oshu_arena_chunk*) calloc(1, sizeof(*chunk) + capacity);
+	if (!chunk)
+		abort();
+	chunk->previous = arena->chunks;
+	chunk->capacity = capacity;
+	arena->chunks = chunk;
+	if (capacity < max_chunk_size)
+		arena->next_size = capacity * 2;
+	return chunk;
+}
+
+void* oshu_arena_calloc(struct oshu_arena *arena, size_t count, size_t size)
+{
+	assert (size == 0 || count <= (size_t) -1 / size);
+	size_t bytes = align(count * size);
+	struct oshu_arena_chunk *chunk = arena->chunks;
+	if (!chunk || chunk->capacity - chunk->used < bytes)
+		chunk = new_chunk(arena, bytes);
+	void *ptr = chunk->data + chunk->used;
+	chunk->used += bytes;
+	return ptr;
+}
+
+void* oshu_arena_realloc(struct oshu_arena *arena, void *ptr, size_t old_size, size_t new_size)
+{
+	void *grown = oshu_arena_calloc(arena, 1, new_size);
+	if (ptr)
+		memcpy(grown, ptr, old_size < new_size ? old_size : new_size);
+	return grown;
+}
+
+void oshu_arena_free(struct oshu_arena *arena)
+{
+	struct oshu_arena_chunk *chunk = arena->chunks;
+	while (chunk) {
+		struct oshu_arena_chunk *previous = chunk->previous;
+		free(chunk);
+		chunk = previous;
+	}
+	arena->chunks = NULL;
+	arena->next_size = 0;
+}
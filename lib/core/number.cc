@@ -0,0 +1,146 @@
+/**
+ * \file lib/core/number.cc
+ * \ingroup core_number
+ */
+
+#include "core/number.h"
+
+#include <limits.h>
+#include <locale.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+static bool is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+static bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+int oshu_strtoi(const char *str, char **end)
+{
+	const char *p = str;
+	while (is_space(*p))
+		++p;
+	bool negative = false;
+	if (*p == '-' || *p == '+')
+		negative = *p++ == '-';
+	if (!is_digit(*p)) {
+		*end = (char*) str;
+		return 0;
+	}
+	/* accumulate as a negative number, whose range is the widest */
+	long long value = 0;
+	for (; is_digit(*p); ++p) {
+		if (value > LLONG_MIN / 100)
+			value = value * 10 - (*p - '0');
+	}
+	*end = (char*) p;
+	if (!negative)
+		value = -value;
+	if (value < INT_MIN)
+		return INT_MIN;
+	if (value > INT_MAX)
+		return INT_MAX;
+	return value;
+}
+
+/**
+ * Powers of 10 that are exactly representable as a double.
+ */
+static const double powers_of_ten[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/**
+ * Largest integer below which every integer is exactly representable as a
+ * double.
+ */
+static const uint64_t max_exact_integer = (uint64_t) 1 << 53;
+
+/**
+ * Delegate the hard cases to the C library, with the C locale.
+ */
+static double slow_strtod(const char *str, char **end)
+{
+	static locale_t c_locale = newlocale(LC_ALL_MASK, "C", (locale_t) 0);
+	return strtod_l(str, end, c_locale);
+}
+
+/**
+ * When the mantissa and the power of ten are both exact doubles, a single
+ * multiplication or division gives the correctly rounded result, because IEEE
+ * 754 operations are correctly rounded. This is Clinger's fast path.
+ */
+double oshu_strtod(const char *str, char **end)
+{
+	const char *p = str;
+	while (is_space(*p))
+		++p;
+	bool negative = false;
+	if (*p == '-' || *p == '+')
+		negative = *p++ == '-';
+	if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+		return slow_strtod(str, end);
+	uint64_t mantissa = 0;
+	int digits = 0; /* significant digits, without the leading zeros */
+	int exponent = 0;
+	bool any_digit = false;
+	for (; is_digit(*p); ++p) {
+		any_digit = true;
+		if (mantissa == 0 && *p == '0')
+			continue;
+		if (++digits <= 19)
+			mantissa = mantissa * 10 + (*p - '0');
+		else
+			++exponent;
+	}
+	if (*p == '.') {
+		++p;
+		for (; is_digit(*p); ++p) {
+			any_digit = true;
+			if (mantissa == 0 && *p == '0') {
+				--exponent;
+				continue;
+			}
+			if (++digits <= 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				--exponent;
+			}
+		}
+	}
+	if (!any_digit)
+		return slow_strtod(str, end); /* inf, nan, or no number at all */
+	if (*p == 'e' || *p == 'E') {
+		const char *q = p + 1;
+		bool negative_exponent = false;
+		if (*q == '-' || *q == '+')
+			negative_exponent = *q++ == '-';
+		if (is_digit(*q)) {
+			int value = 0;
+			for (; is_digit(*q); ++q) {
+				if (value < 100000)
+					value = value * 10 + (*q - '0');
+			}
+			exponent += negative_exponent ? -value : value;
+			p = q;
+		}
+	}
+	if (mantissa == 0) {
+		*end = (char*) p;
+		return negative ? -0. : 0.;
+	}
+	if (digits > 19 || mantissa > max_exact_integer || exponent < -22 || exponent > 22)
+		return slow_strtod(str, end);
+	double value = mantissa;
+	if (exponent < 0)
+		value /= powers_of_ten[-exponent];
+	else
+		value *= powers_of_ten[exponent];
+	*end = (char*) p;
+	return negative ? -value : value;
+}
@@ -0,0 +1,144 @@
+/**
+ * \file lib/core/thread_pool.cc
+ * \ingroup core_thread_pool
+ */
+
+#include "core/thread_pool.h"
+
+namespace oshu {
+inline namespace core {
+
+/**
+ * Identify the pool and queue of the worker running on the current thread, so
+ * that sub-tasks can be queued locally.
+ *
+ * Both are null outside workers.
+ */
+static thread_local thread_pool *current_pool = nullptr;
+static thread_local int current_queue = -1;
+
+thread_pool::thread_pool(int count)
+{
+	if (count <= 0)
+		count = std::thread::hardware_concurrency();
+	if (count <= 0)
+		count = 1;
+	for (int i = 0; i < count; ++i)
+		queues.emplace_back(new worker_queue);
+	for (int i = 0; i < count; ++i)
+		workers.emplace_back(&thread_pool::work, this, i);
+}
+
+thread_pool::~thread_pool()
+{
+	{
+		std::unique_lock<std::mutex> lock(state);
+		idle.wait(lock, [this]{ return pending == 0; });
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread &worker : workers)
+		worker.join();
+}
+
+int thread_pool::size() const
+{
+	return workers.size();
+}
+
+void thread_pool::submit(std::function<void()> task)
+{
+	int index;
+	{
+		/* count the task first, so that the counters never underflow
+		 * when a worker grabs it right after it is queued */
+		std::lock_guard<std::mutex> lock(state);
+		++queued;
+		++pending;
+		if (current_pool == this) {
+			index = current_queue;
+		} else {
+			index = next_queue;
+			next_queue = (next_queue + 1) % queues.size();
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock(queues[index]->mutex);
+		queues[index]->tasks.push_back(std::move(task));
+	}
+	wake.notify_one();
+}
+
+void thread_pool::wait()
+{
+	std::unique_lock<std::mutex> lock(state);
+	idle.wait(lock, [this]{ return pending == 0; });
+	if (failure) {
+		std::exception_ptr e = failure;
+		failure = nullptr;
+		std::rethrow_exception(e);
+	}
+}
+
+/**
+ * Take the newest task of the worker's own queue, or else the oldest task of
+ * another queue.
+ */
+bool thread_pool::pop(int index, std::function<void()> &task)
+{
+	int count = queues.size();
+	for (int i = 0; i < count; ++i) {
+		worker_queue &queue = *queues[(index + i) % count];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty())
+			continue;
+		if (i == 0) {
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+		} else {
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+		}
+		return true;
+	}
+	return false;
+}
+
+void thread_pool::work(int index)
+{
+	current_pool = this;
+	current_queue = index;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(state);
+			wake.wait(lock, [this]{ return stopping || queued > 0; });
+			if (stopping)
+				return;
+		}
+		std::function<void()> task;
+		if (!pop(index, task))
+			continue; /* another worker was faster */
+		{
+			std::lock_guard<std::mutex> lock(state);
+			--queued;
+		}
+		std::exception_ptr error;
+		try {
+			task();
+		} catch (...) {
+			error = std::current_exception();
+		}
+		bool done;
+		{
+			std::lock_guard<std::mutex> lock(state);
+			if (error && !failure)
+				failure = std::move(error);
+			error = nullptr;
+			done = --pending == 0;
+		}
+		if (done)
+			idle.notify_all();
+	}
+}
+
+}}
@@ -8,33 +8,41 @@
 
 #include <assert.h>
 
+#include <algorithm>
+
 void oshu_rewind_game(struct oshu_game *game, double offset)
 {
-	oshu_seek_music(&game->audio, game->audio.music.current_timestamp - offset);
-	game->clock.now = game->audio.music.current_timestamp;
+	oshu_seek_music(&game->audio, game->audio.position - offset);
+	game->clock.now = game->audio.position;
 	game->relinquish();
 	oshu_print_state(game);
 
 	assert (game->hit_cursor != NULL);
-	while (game->hit_cursor->time > game->clock.now + 1.) {
-		game->hit_cursor->state = OSHU_INITIAL_HIT;
-		game->hit_cursor = game->hit_cursor->previous;
-	}
+	struct oshu_hit_table *table = &game->beatmap.table;
+	double *end = table->time + table->size;
+	int target = std::upper_bound(table->time, end, game->clock.now + 1.) - table->time - 1;
+	int i = game->hit_cursor->index;
+	for (; i > target; --i)
+		oshu_set_hit_state(table, table->hits[i], OSHU_INITIAL_HIT);
+	game->hit_cursor = table->hits[i];
 }
 
 void oshu_forward_game(struct oshu_game *game, double offset)
 {
-	oshu_seek_music(&game->audio, game->audio.music.current_timestamp + offset);
-	game->clock.now = game->audio.music.current_timestamp;
+	oshu_seek_music(&game->audio, game->audio.position + offset);
+	game->clock.now = game->audio.position;
 	game->relinquish();
 
 	oshu_print_state(game);
 
 	assert (game->hit_cursor != NULL);
-	while (game->hit_cursor->time < game->clock.now + 1.) {
-		game->hit_cursor->state = OSHU_SKIPPED_HIT;
-		game->hit_cursor = game->hit_cursor->next;
-	}
+	struct oshu_hit_table *table = &game->beatmap.table;
+	double *end = table->time + table->size;
+	int target = std::lower_bound(table->time, end, game->clock.now + 1.) - table->time;
+	int i = game->hit_cursor->index;
+	for (; i < target; ++i)
+		oshu_set_hit_state(table, table->hits[i], OSHU_SKIPPED_HIT);
+	game->hit_cursor = table->hits[i];
 }
 
 void oshu_pause_game(struct oshu_game *game)
@@ -31,7 +31,7 @@ void oshu_update_clock(struct oshu_game *game)
 	double system = SDL_GetTicks() / 1000.;
 	double diff = system - clock->system;
 	double prev_audio = clock->audio;
-	clock->audio = game->audio.music.current_timestamp;
+	clock->audio = game->audio.position;
 	clock->before = clock->now;
 	clock->system = system;
 
@@ -18,7 +18,7 @@
 
 static int open_beatmap(const char *beatmap_path, struct oshu_game *game)
 {
-	if (oshu_load_beatmap(beatmap_path, &game->beatmap) < 0) {
+	if (oshu_load_cached_beatmap(beatmap_path, &game->beatmap) < 0) {
 		oshu_log_error("no beatmap, aborting");
 		return -1;
 	}
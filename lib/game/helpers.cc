@@ -5,32 +5,26 @@
 
 #include "game/game.h"
 
+#include <algorithm>
+
 struct oshu_hit* oshu_look_hit_back(struct oshu_game *game, double offset)
 {
-	struct oshu_hit *hit = game->hit_cursor;
+	struct oshu_hit_table *table = &game->beatmap.table;
 	double target = game->clock.now - offset;
-	/* seek backward */
-	while (oshu_hit_end_time(hit) > target)
-		hit = hit->previous;
-	/* seek forward */
-	while (oshu_hit_end_time(hit) < target)
-		hit = hit->next;
-	/* here we have the guarantee that hit->time >= target */
-	return hit;
+	double *end = table->max_end_time + table->size;
+	int i = std::lower_bound(table->max_end_time, end, target) - table->max_end_time;
+	/* here we have the guarantee that the hit ends at or after target */
+	return table->hits[i];
 }
 
 struct oshu_hit* oshu_look_hit_up(struct oshu_game *game, double offset)
 {
-	struct oshu_hit *hit = game->hit_cursor;
+	struct oshu_hit_table *table = &game->beatmap.table;
 	double target = game->clock.now + offset;
-	/* seek forward */
-	while (hit->time < target)
-		hit = hit->next;
-	/* seek backward */
-	while (hit->time > target)
-		hit = hit->previous;
+	double *end = table->time + table->size;
+	int i = std::upper_bound(table->time, end, target) - table->time - 1;
 	/* here we have the guarantee that hit->time <= target */
-	return hit;
+	return table->hits[i];
 }
 
 struct oshu_hit* oshu_next_hit(struct oshu_game *game)
@@ -12,6 +12,14 @@
 
 #include <assert.h>
 
+/**
+ * How far ahead autoplay schedules the hit sounds, in seconds.
+ *
+ * It must be longer than the audio device buffer, so that every sound is
+ * scheduled before the audio callback mixes the buffer it falls into.
+ */
+static const double autoplay_lookahead = .2;
+
 osu_game::osu_game(const char *beatmap_path)
 : oshu_game(beatmap_path)
 {
@@ -27,15 +35,19 @@ osu_game::osu_game(const char *beatmap_path)
  */
 static struct oshu_hit* find_hit(struct osu_game *game, oshu_point p)
 {
+	struct oshu_hit_table *table = &game->beatmap.table;
 	struct oshu_hit *start = oshu_look_hit_back(game, game->beatmap.difficulty.approach_time);
 	double max_time = game->clock.now + game->beatmap.difficulty.approach_time;
-	for (struct oshu_hit *hit = start; hit->time <= max_time; hit = hit->next) {
-		if (!(hit->type & (OSHU_CIRCLE_HIT | OSHU_SLIDER_HIT)))
+	double radius = game->beatmap.difficulty.circle_radius;
+	for (int i = start->index; table->time[i] <= max_time; ++i) {
+		if (!(table->type[i] & (OSHU_CIRCLE_HIT | OSHU_SLIDER_HIT)))
 			continue;
-		if (hit->state != OSHU_INITIAL_HIT)
+		if (table->state[i] != OSHU_INITIAL_HIT)
 			continue;
-		if (std::abs(p - hit->p) <= game->beatmap.difficulty.circle_radius)
-			return hit;
+		double dx = table->x[i] - std::real(p);
+		double dy = table->y[i] - std::imag(p);
+		if (dx * dx + dy * dy <= radius * radius)
+			return table->hits[i];
 	}
 	return NULL;
 }
@@ -66,13 +78,16 @@ static void release_slider(struct osu_game *game)
 		return;
 	assert (hit->type & OSHU_SLIDER_HIT);
 	if (game->clock.now < oshu_hit_end_time(hit) - game->beatmap.difficulty.leniency) {
-		hit->state = OSHU_MISSED_HIT;
+		oshu_set_hit_state(&game->beatmap.table, hit, OSHU_MISSED_HIT);
 	} else {
-		hit->state = OSHU_GOOD_HIT;
-		oshu_play_sound(&game->library, &hit->slider.sounds[hit->slider.repeat], &game->audio);
+		oshu_set_hit_state(&game->beatmap.table, hit, OSHU_GOOD_HIT);
+		if (!game->autoplay)
+			oshu_play_sound(&game->library, &hit->slider.sounds[hit->slider.repeat], &game->audio);
 	}
 	jettison_hit(hit);
-	oshu_stop_loop(&game->audio);
+	/* in autoplay mode, the end of the loop is scheduled */
+	if (!game->autoplay)
+		oshu_stop_loop(&game->audio);
 	game->current_slider = NULL;
 }
 
@@ -91,7 +106,7 @@ static void sonorize_slider(struct osu_game *game)
 	int prev_t = (game->clock.before - hit->time) / hit->slider.duration;
 	if (game->clock.now > oshu_hit_end_time(hit)) {
 		release_slider(game);
-	} else if (t > prev_t && prev_t >= 0) {
+	} else if (t > prev_t && prev_t >= 0 && !game->autoplay) {
 		assert (t <= hit->slider.repeat);
 		oshu_play_sound(&game->library, &hit->slider.sounds[t], &game->audio);
 	}
@@ -118,7 +133,7 @@ int osu_game::check()
 		if (std::abs(ball - m) > this->beatmap.difficulty.slider_tolerance) {
 			oshu_stop_loop(&this->audio);
 			this->current_slider = NULL;
-			hit->state = OSHU_MISSED_HIT;
+			oshu_set_hit_state(&this->beatmap.table, hit, OSHU_MISSED_HIT);
 			jettison_hit(hit);
 		}
 	}
@@ -127,9 +142,9 @@ int osu_game::check()
 	while (this->hit_cursor->time < left_wall) {
 		struct oshu_hit *hit = this->hit_cursor;
 		if (!(hit->type & (OSHU_CIRCLE_HIT | OSHU_SLIDER_HIT))) {
-			hit->state = OSHU_UNKNOWN_HIT;
+			oshu_set_hit_state(&this->beatmap.table, hit, OSHU_UNKNOWN_HIT);
 		} else if (hit->state == OSHU_INITIAL_HIT) {
-			hit->state = OSHU_MISSED_HIT;
+			oshu_set_hit_state(&this->beatmap.table, hit, OSHU_MISSED_HIT);
 			jettison_hit(hit);
 		}
 		this->hit_cursor = hit->next;
@@ -144,30 +159,64 @@ int osu_game::check()
  * Unknown hits are marked as unknown.
  *
  * The key is the held key, relevant only for sliders. In autoplay mode, it's
- * value doesn't matter.
+ * value doesn't matter, and no sound is played because #schedule_hit_sounds
+ * took care of it.
  */
 static void activate_hit(struct osu_game *game, struct oshu_hit *hit, enum oshu_finger key)
 {
 	if (hit->type & OSHU_SLIDER_HIT) {
 		release_slider(game);
-		hit->state = OSHU_SLIDING_HIT;
+		oshu_set_hit_state(&game->beatmap.table, hit, OSHU_SLIDING_HIT);
 		game->current_slider = hit;
 		game->held_key = key;
-		oshu_play_sound(&game->library, &hit->sound, &game->audio);
-		oshu_play_sound(&game->library, &hit->slider.sounds[0], &game->audio);
+		if (!game->autoplay) {
+			oshu_play_sound(&game->library, &hit->sound, &game->audio);
+			oshu_play_sound(&game->library, &hit->slider.sounds[0], &game->audio);
+		}
 	} else if (hit->type & OSHU_CIRCLE_HIT) {
-		hit->state = OSHU_GOOD_HIT;
-		oshu_play_sound(&game->library, &hit->sound, &game->audio);
+		oshu_set_hit_state(&game->beatmap.table, hit, OSHU_GOOD_HIT);
+		if (!game->autoplay)
+			oshu_play_sound(&game->library, &hit->sound, &game->audio);
 	} else {
-		hit->state = OSHU_UNKNOWN_HIT;
+		oshu_set_hit_state(&game->beatmap.table, hit, OSHU_UNKNOWN_HIT);
+	}
+}
+
+/**
+ * Schedule every sound a hit makes in a perfect run, from its beginning to its
+ * end.
+ */
+static void schedule_hit_sounds(struct osu_game *game, struct oshu_hit *hit)
+{
+	if (hit->type & OSHU_SLIDER_HIT) {
+		/* channel 0 is for the sliders played by hand */
+		if (++game->autoplay_channel <= 0)
+			game->autoplay_channel = 1;
+		int channel = game->autoplay_channel;
+		oshu_schedule_sound(&game->library, &hit->sound, &game->audio, channel, hit->time);
+		for (int t = 0; t <= hit->slider.repeat; ++t)
+			oshu_schedule_sound(&game->library, &hit->slider.sounds[t], &game->audio, channel, hit->time + t * hit->slider.duration);
+		oshu_schedule_stop_loop(&game->audio, channel, oshu_hit_end_time(hit));
+	} else if (hit->type & OSHU_CIRCLE_HIT) {
+		oshu_schedule_sound(&game->library, &hit->sound, &game->audio, 0, hit->time);
 	}
 }
 
 /**
  * Automatically activate the sliders on time.
+ *
+ * The hit sounds are scheduled #autoplay_lookahead seconds in advance, so that
+ * they start at the exact sample.
  */
 int osu_game::check_autoplay()
 {
+	double horizon = this->clock.now + autoplay_lookahead;
+	for (struct oshu_hit *hit = this->hit_cursor; hit->time < horizon; hit = hit->next) {
+		if (hit->time >= this->autoplay_horizon)
+			schedule_hit_sounds(this, hit);
+	}
+	if (horizon > this->autoplay_horizon)
+		this->autoplay_horizon = horizon;
 	sonorize_slider(this);
 	while (this->hit_cursor->time < this->clock.now) {
 		activate_hit(this, this->hit_cursor, OSHU_UNKNOWN_KEY);
@@ -193,7 +242,7 @@ int osu_game::press(enum oshu_finger key)
 		activate_hit(this, hit, key);
 		hit->offset = this->clock.now - hit->time;
 	} else {
-		hit->state = OSHU_MISSED_HIT;
+		oshu_set_hit_state(&this->beatmap.table, hit, OSHU_MISSED_HIT);
 		jettison_hit(hit);
 	}
 	return 0;
@@ -212,8 +261,10 @@ int osu_game::release(enum oshu_finger key)
 
 int osu_game::relinquish()
 {
+	/* seeking cleared the schedule */
+	this->autoplay_horizon = this->clock.now;
 	if (this->current_slider) {
-		this->current_slider->state = OSHU_INITIAL_HIT;
+		oshu_set_hit_state(&this->beatmap.table, this->current_slider, OSHU_INITIAL_HIT);
 		oshu_stop_loop(&this->audio);
 		this->current_slider = NULL;
 	}
@@ -7,11 +7,15 @@
 
 #include "beatmap/beatmap.h"
 #include "core/log.h"
+#include "core/thread_pool.h"
+#include "library/manifest.h"
 
 #include <algorithm>
+#include <cstring>
 #include <dirent.h>
 #include <iostream>
-#include <sstream>
+#include <memory>
+#include <sys/stat.h>
 #include <system_error>
 
 namespace oshu {
@@ -20,16 +24,14 @@ namespace library {
 beatmap_entry::beatmap_entry(const std::string &path)
 : path(path)
 {
-	oshu_beatmap beatmap;
-	int rc = oshu_load_beatmap_headers(path.c_str(), &beatmap);
-	if (rc < 0)
+	oshu_beatmap_info info;
+	if (oshu_scan_beatmap(path.c_str(), &info) < 0)
 		throw std::runtime_error("could not load beatmap " + path);
-	mode = beatmap.mode;
-	difficulty = beatmap.difficulty.overall_difficulty;
-	title = beatmap.metadata.title;
-	artist = beatmap.metadata.artist;
-	version = beatmap.metadata.version;
-	oshu_destroy_beatmap(&beatmap);
+	mode = info.mode;
+	difficulty = info.difficulty.overall_difficulty;
+	title = info.title;
+	artist = info.artist;
+	version = info.difficulty_name;
 }
 
 static bool osu_file(const char *filename)
@@ -40,40 +42,67 @@ static bool osu_file(const char *filename)
 	return !strcmp(filename + l - 4, ".osu");
 }
 
-static void find_entries(const std::string &path, beatmap_set &set)
+/**
+ * List the non-hidden files of a directory, sorted by name so that the
+ * results don't depend on the order of the directory entries.
+ */
+static std::vector<std::string> list_directory(const std::string &path)
 {
+	std::vector<std::string> names;
 	DIR *dir = opendir(path.c_str());
 	if (!dir)
-		throw std::system_error(errno, std::system_category(), "could not open the beatmap set directory " + path);
+		throw std::system_error(errno, std::system_category(), "could not open the directory " + path);
 	for (;;) {
 		errno = 0;
 		struct dirent* entry = readdir(dir);
 		if (errno) {
-			throw std::system_error(errno, std::system_category(), "could not read the beatmap set directory " + path);
+			int error = errno;
+			closedir(dir);
+			throw std::system_error(error, std::system_category(), "could not read the directory " + path);
 		} else if (!entry) {
 			// end of directory
 			break;
 		} else if (entry->d_name[0] == '.') {
 			// hidden file, ignore
 			continue;
-		} else if (!osu_file(entry->d_name)) {
-			continue;
 		} else {
-			try {
-				std::ostringstream os;
-				os << path << "/" << entry->d_name;
-				beatmap_entry entry (os.str());
-				if (entry.mode != OSHU_OSU_MODE)
-					oshu::log::debug() << "skipping " << path << ": unsupported mode" << std::endl;
-				else
-					set.entries.push_back(std::move(entry));
-			} catch(std::runtime_error &e) {
-				oshu::log::warning() << e.what() << std::endl;
-				oshu::log::warning() << "ignoring invalid beatmap " << path << std::endl;
-			}
+			names.push_back(entry->d_name);
 		}
 	}
 	closedir(dir);
+	std::sort(names.begin(), names.end());
+	return names;
+}
+
+/**
+ * List the paths to the .osu files of a beatmap set.
+ */
+static std::vector<std::string> find_entries(const std::string &path)
+{
+	std::vector<std::string> paths;
+	for (const std::string &name : list_directory(path)) {
+		if (osu_file(name.c_str()))
+			paths.push_back(path + "/" + name);
+	}
+	return paths;
+}
+
+/**
+ * Load a beatmap entry, or return null if the beatmap is invalid or its mode
+ * is not supported.
+ */
+static std::unique_ptr<beatmap_entry> load_entry(const std::string &path)
+{
+	try {
+		std::unique_ptr<beatmap_entry> entry {new beatmap_entry(path)};
+		if (entry->mode == OSHU_OSU_MODE)
+			return entry;
+		oshu::log::debug() << "skipping " << path << ": unsupported mode" << std::endl;
+	} catch(std::runtime_error &e) {
+		oshu::log::warning() << e.what() << std::endl;
+		oshu::log::warning() << "ignoring invalid beatmap " << path << std::endl;
+	}
+	return nullptr;
 }
 
 static bool compare_entries(const beatmap_entry &a, const beatmap_entry &b)
@@ -81,14 +110,29 @@ static bool compare_entries(const beatmap_entry &a, const beatmap_entry &b)
 	return a.difficulty < b.difficulty;
 }
 
+/**
+ * Sort the entries and take the set's metadata from its first entry.
+ *
+ * The sort is stable, so that entries of equal difficulty stay sorted by file
+ * name.
+ */
+static void index_set(beatmap_set &set)
+{
+	if (!set.empty()) {
+		set.title = set.entries[0].title;
+		set.artist = set.entries[0].artist;
+		std::stable_sort(set.entries.begin(), set.entries.end(), compare_entries);
+	}
+}
+
 beatmap_set::beatmap_set(const std::string &path)
 {
-	find_entries(path, *this);
-	if (!empty()) {
-		title = entries[0].title;
-		artist = entries[0].artist;
-		std::sort(entries.begin(), entries.end(), compare_entries);
+	for (const std::string &entry_path : find_entries(path)) {
+		std::unique_ptr<beatmap_entry> entry = load_entry(entry_path);
+		if (entry)
+			entries.push_back(std::move(*entry));
 	}
+	index_set(*this);
 }
 
 bool beatmap_set::empty() const
@@ -96,37 +140,134 @@ bool beatmap_set::empty() const
 	return entries.empty();
 };
 
-std::vector<beatmap_set> find_beatmap_sets(const std::string &path)
+static bool same_time(const struct timespec &a, const struct timespec &b)
 {
-	std::vector<beatmap_set> sets;
+	return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
 
-	DIR *dir = opendir(path.c_str());
-	if (!dir)
-		throw std::system_error(errno, std::system_category(), "could not open the beatmaps directory " + path);
-	for (;;) {
-		errno = 0;
-		struct dirent* entry = readdir(dir);
-		if (errno) {
-			throw std::system_error(errno, std::system_category(), "could not read the beatmaps directory");
-		} else if (!entry) {
-			// end of directory
-			break;
-		} else if (entry->d_name[0] == '.') {
-			// hidden directory, ignore
-			continue;
-		} else {
-			try {
-				std::ostringstream os;
-				os << path << "/" << entry->d_name;
-				beatmap_set set (os.str());
-				if (!set.empty())
-					sets.push_back(std::move(set));
-			} catch (std::system_error& e) {
-				oshu::log::debug() << e.what() << std::endl;
+/**
+ * Load a .osu file for the manifest, unless the manifest already knows it in
+ * its current state.
+ */
+static manifest_file scan_file(const std::string &path, const manifest_directory *known)
+{
+	manifest_file file;
+	struct stat st;
+	if (stat(path.c_str(), &st) < 0) {
+		oshu::log::warning() << "could not stat " << path << ": " << strerror(errno) << std::endl;
+		return file;
+	}
+	if (known) {
+		auto it = known->files.find(path);
+		if (it != known->files.end() && it->second.size == st.st_size && same_time(it->second.mtime, st.st_mtim))
+			return it->second;
+	}
+	file.size = st.st_size;
+	file.mtime = st.st_mtim;
+	try {
+		file.entry = beatmap_entry(path);
+		file.valid = true;
+	} catch(std::runtime_error &e) {
+		oshu::log::warning() << e.what() << std::endl;
+		oshu::log::warning() << "ignoring invalid beatmap " << path << std::endl;
+	}
+	return file;
+}
+
+/**
+ * Intermediate results of #find_beatmap_sets for one set.
+ *
+ * Every file gets its own slot, filled by its own task, so that the tasks
+ * never need to synchronize.
+ */
+struct pending_set {
+	std::string path;
+	/**
+	 * What the previous manifest knew about the set, or null.
+	 */
+	const manifest_directory *known = nullptr;
+	bool found = false;
+	struct timespec mtime = {};
+	std::vector<std::string> paths;
+	std::vector<manifest_file> slots;
+};
+
+/**
+ * Find the .osu files of a set, and queue a task for each of them.
+ *
+ * If the directory didn't change since the last scan, the list of files is
+ * taken from the manifest.
+ */
+static void scan_set(pending_set &set, thread_pool &pool)
+{
+	struct stat st;
+	if (stat(set.path.c_str(), &st) < 0 || !S_ISDIR(st.st_mode))
+		return;
+	set.mtime = st.st_mtim;
+	if (set.known && same_time(set.known->mtime, set.mtime)) {
+		for (auto &f : set.known->files)
+			set.paths.push_back(f.first);
+	} else {
+		try {
+			set.paths = find_entries(set.path);
+		} catch (std::system_error& e) {
+			oshu::log::debug() << e.what() << std::endl;
+			return;
+		}
+	}
+	set.found = true;
+	set.slots.resize(set.paths.size());
+	for (size_t j = 0; j < set.paths.size(); ++j) {
+		manifest_file *slot = &set.slots[j];
+		const std::string *path = &set.paths[j];
+		const manifest_directory *known = set.known;
+		pool.submit([slot, path, known] {
+			*slot = scan_file(*path, known);
+		});
+	}
+}
+
+std::vector<beatmap_set> find_beatmap_sets(const std::string &path, int jobs, manifest *cache)
+{
+	std::vector<std::string> names = list_directory(path);
+	std::vector<pending_set> pending (names.size());
+	{
+		thread_pool pool {jobs};
+		for (size_t i = 0; i < names.size(); ++i) {
+			pending_set *set = &pending[i];
+			set->path = path + "/" + names[i];
+			if (cache) {
+				auto it = cache->directories.find(set->path);
+				if (it != cache->directories.end())
+					set->known = &it->second;
 			}
+			pool.submit([set, &pool] { scan_set(*set, pool); });
 		}
+		pool.wait();
 	}
-	closedir(dir);
+	std::vector<beatmap_set> sets;
+	manifest updated;
+	for (pending_set &p : pending) {
+		if (!p.found)
+			continue;
+		manifest_directory &dir = updated.directories[p.path];
+		dir.mtime = p.mtime;
+		beatmap_set set;
+		for (size_t j = 0; j < p.paths.size(); ++j) {
+			manifest_file &file = p.slots[j];
+			if (file.valid && file.entry.mode == OSHU_OSU_MODE)
+				set.entries.push_back(file.entry);
+			else if (file.valid)
+				oshu::log::debug() << "skipping " << p.paths[j] << ": unsupported mode" << std::endl;
+			if (file.mtime.tv_sec || file.mtime.tv_nsec)
+				dir.files[p.paths[j]] = std::move(file);
+		}
+		index_set(set);
+		if (!set.empty())
+			sets.push_back(std::move(set));
+	}
+	if (cache)
+		*cache = std::move(updated);
 	return sets;
 }
 
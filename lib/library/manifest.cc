@@ -0,0 +1,170 @@
+/**
+ * \file lib/library/manifest.cc
+ * \ingroup library_manifest
+ */
+
+#include "library/manifest.h"
+
+#include "core/log.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+#include <vector>
+
+namespace oshu {
+namespace library {
+
+static const char *manifest_header = "oshu! manifest 1";
+
+static std::string escape(const std::string &str)
+{
+	std::string out;
+	out.reserve(str.size());
+	for (char c : str) {
+		switch (c) {
+		case '\\': out += "\\\\"; break;
+		case '\t': out += "\\t"; break;
+		case '\n': out += "\\n"; break;
+		default:   out += c;
+		}
+	}
+	return out;
+}
+
+static std::string unescape(const std::string &str)
+{
+	std::string out;
+	out.reserve(str.size());
+	for (size_t i = 0; i < str.size(); ++i) {
+		if (str[i] != '\\' || i + 1 == str.size()) {
+			out += str[i];
+			continue;
+		}
+		switch (str[++i]) {
+		case 't': out += '\t'; break;
+		case 'n': out += '\n'; break;
+		default:  out += str[i];
+		}
+	}
+	return out;
+}
+
+/**
+ * Split a record on tabs, keeping the empty fields.
+ */
+static std::vector<std::string> split(const std::string &line)
+{
+	std::vector<std::string> fields;
+	size_t start = 0;
+	for (;;) {
+		size_t tab = line.find('\t', start);
+		fields.push_back(unescape(line.substr(start, tab - start)));
+		if (tab == std::string::npos)
+			break;
+		start = tab + 1;
+	}
+	return fields;
+}
+
+static std::ostream& operator<<(std::ostream &os, const struct timespec &t)
+{
+	char nsec[16];
+	std::snprintf(nsec, sizeof(nsec), "%09ld", (long) t.tv_nsec);
+	return os << t.tv_sec << "." << nsec;
+}
+
+static struct timespec parse_time(const std::string &str)
+{
+	struct timespec t {};
+	size_t dot = str.find('.');
+	t.tv_sec = std::stoll(str.substr(0, dot));
+	if (dot != std::string::npos)
+		t.tv_nsec = std::stol(str.substr(dot + 1));
+	return t;
+}
+
+/**
+ * Parse one file record. Throw an exception if it is invalid.
+ */
+static void parse_file(const std::vector<std::string> &fields, manifest_directory &dir)
+{
+	if (fields.size() != 10)
+		throw std::runtime_error("invalid file record");
+	manifest_file file;
+	file.size = std::stoll(fields[1]);
+	file.mtime = parse_time(fields[2]);
+	file.valid = std::stoi(fields[3]);
+	file.entry.mode = static_cast<oshu_mode>(std::stoi(fields[4]));
+	file.entry.difficulty = std::stoi(fields[5]);
+	file.entry.path = fields[6];
+	file.entry.title = fields[7];
+	file.entry.artist = fields[8];
+	file.entry.version = fields[9];
+	dir.files[file.entry.path] = std::move(file);
+}
+
+manifest read_manifest(const std::string &path)
+{
+	manifest m;
+	std::ifstream is(path);
+	if (!is) {
+		oshu::log::debug() << "no manifest found at " << path << std::endl;
+		return m;
+	}
+	std::string line;
+	if (!std::getline(is, line) || line != manifest_header) {
+		oshu::log::warning() << "ignoring the unsupported manifest " << path << std::endl;
+		return m;
+	}
+	manifest_directory *dir = nullptr;
+	int line_number = 1;
+	try {
+		while (std::getline(is, line)) {
+			++line_number;
+			std::vector<std::string> fields = split(line);
+			if (fields.size() == 3 && fields[0] == "D") {
+				dir = &m.directories[fields[2]];
+				dir->mtime = parse_time(fields[1]);
+			} else if (dir && !fields.empty() && fields[0] == "F") {
+				parse_file(fields, *dir);
+			} else {
+				throw std::runtime_error("unexpected record");
+			}
+		}
+	} catch (std::exception &e) {
+		oshu::log::warning() << path << ":" << line_number << ": " << e.what() << "; ignoring the manifest" << std::endl;
+		return manifest {};
+	}
+	return m;
+}
+
+void write_manifest(const manifest &m, const std::string &path)
+{
+	std::string temp = path + ".new";
+	{
+		std::ofstream os(temp);
+		os << manifest_header << "\n";
+		for (auto &d : m.directories) {
+			os << "D\t" << d.second.mtime << "\t" << escape(d.first) << "\n";
+			for (auto &f : d.second.files) {
+				const manifest_file &file = f.second;
+				os << "F\t" << file.size << "\t" << file.mtime << "\t" << file.valid
+				   << "\t" << file.entry.mode << "\t" << file.entry.difficulty
+				   << "\t" << escape(f.first) << "\t" << escape(file.entry.title)
+				   << "\t" << escape(file.entry.artist) << "\t" << escape(file.entry.version)
+				   << "\n";
+			}
+		}
+		os.close();
+		if (!os)
+			throw std::runtime_error("could not write the manifest " + temp);
+	}
+	if (std::rename(temp.c_str(), path.c_str()) < 0)
+		throw std::system_error(errno, std::system_category(), "could not replace the manifest " + path);
+	oshu::log::debug() << "wrote the manifest to " << path << std::endl;
+}
+
+}}
@@ -5,23 +5,25 @@
 
 #include "ui/audio.h"
 
-#include "audio/stream.h"
+#include "audio/audio.h"
 #include "video/display.h"
 
 #include <assert.h>
 #include <SDL2/SDL.h>
 
-int oshu_create_audio_progress_bar(struct oshu_display *display, struct oshu_stream *stream, struct oshu_audio_progress_bar *bar)
+int oshu_create_audio_progress_bar(struct oshu_display *display, struct oshu_audio *audio, struct oshu_audio_progress_bar *bar)
 {
 	bar->display = display;
-	bar->stream = stream;
+	bar->audio = audio;
 	return 0;
 }
 
 void oshu_show_audio_progress_bar(struct oshu_audio_progress_bar *bar)
 {
-	assert (bar->stream->duration != 0);
-	double progression = bar->stream->current_timestamp / bar->stream->duration;
+	/* the duration is set before the decoding thread starts */
+	double duration = bar->audio->music.duration;
+	assert (duration != 0);
+	double progression = bar->audio->position / duration;
 	if (progression < 0)
 		progression = 0;
 	else if (progression > 1)
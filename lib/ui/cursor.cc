@@ -66,11 +66,10 @@ void oshu_show_cursor(struct oshu_cursor_widget *cursor)
 	for (int i = 1; i <= fireflies; ++i) {
 		int offset = (cursor->offset + i) % fireflies;
 		double ratio = (double) (i + 1) / (fireflies + 1);
-		SDL_SetTextureAlphaMod(cursor->mouse.texture, ratio * 255);
-		oshu_draw_scaled_texture(
+		oshu_draw_faded_texture(
 			cursor->display, &cursor->mouse,
 			cursor->history[offset],
-			ratio
+			ratio, ratio
 		);
 	}
 }
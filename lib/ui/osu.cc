@@ -67,11 +67,9 @@ static void draw_slider(oshu::ui::osu &view, struct oshu_hit *hit)
 	struct oshu_display *display = view.display;
 	double now = game->clock.now;
 	if (hit->state == OSHU_INITIAL_HIT || hit->state == OSHU_SLIDING_HIT) {
-		if (!hit->texture) {
-			osu_paint_slider(view, hit);
-			assert (hit->texture != NULL);
-		}
-		oshu_draw_texture(view.display, hit->texture, hit->p);
+		/* when the painters are late, skip the body for a frame */
+		if (osu_paint_slider(view, hit) == 0)
+			oshu_draw_texture(view.display, hit->texture, hit->p);
 		draw_hint(view, hit);
 		/* ball */
 		double t = (now - hit->time) / hit->slider.duration;
@@ -165,6 +163,7 @@ osu::~osu()
 	SDL_ShowCursor(SDL_ENABLE);
 	osu_free_resources(*this);
 	oshu_destroy_cursor(&cursor);
+	oshu_destroy_batch(&batch);
 }
 
 /**
@@ -174,20 +173,26 @@ osu::~osu()
 void osu::draw()
 {
 	osu_view(display);
+	oshu_tick_atlas(&atlas, game.clock.now);
+	osu_prepaint_sliders(*this);
+	oshu_begin_batch(display, &batch);
+	struct oshu_hit_table *table = &game.beatmap.table;
 	struct oshu_hit *cursor = oshu_look_hit_up(&game, game.beatmap.difficulty.approach_time);
 	struct oshu_hit *next = NULL;
 	double now = game.clock.now;
-	for (struct oshu_hit *hit = cursor; hit; hit = hit->previous) {
-		if (!(hit->type & (OSHU_CIRCLE_HIT | OSHU_SLIDER_HIT)))
+	for (int i = cursor->index; i >= 0; --i) {
+		if (!(table->type[i] & (OSHU_CIRCLE_HIT | OSHU_SLIDER_HIT)))
 			continue;
-		if (oshu_hit_end_time(hit) < now - game.beatmap.difficulty.approach_time)
+		if (table->end_time[i] < now - game.beatmap.difficulty.approach_time)
 			break;
+		struct oshu_hit *hit = table->hits[i];
 		if (next && next->combo == hit->combo)
 			connect_hits(*this, hit, next);
 		draw_hit(*this, hit);
 		next = hit;
 	}
 	oshu_show_cursor(&this->cursor);
+	oshu_end_batch(display);
 	oshu_reset_view(display);
 }
 
@@ -7,11 +7,30 @@
 
 #include "core/log.h"
 #include "game/osu.h"
+#include "video/atlas.h"
+#include "video/display.h"
 #include "video/paint.h"
 
 #include <assert.h>
 #include <SDL2/SDL_timer.h>
 
+#include <mutex>
+#include <vector>
+
+/**
+ * Pack a painted texture in the view's atlas, for good.
+ */
+static int pack_resource(oshu::ui::osu &view, struct oshu_painter *painter, struct oshu_texture *texture)
+{
+	oshu_end_offscreen_painting(painter);
+	return oshu_pack_painting(painter, &view.atlas, 0, texture);
+}
+
+static bool is_painted(struct oshu_hit *hit)
+{
+	return hit->texture && hit->texture->texture;
+}
+
 static double brighter(double v)
 {
 	v += .3;
@@ -34,7 +53,7 @@ static int paint_approach_circle(oshu::ui::osu &view)
 	cairo_stroke(p.cr);
 
 	struct oshu_texture *texture = &view.approach_circle;
-	int rc = oshu_finish_painting(&p, texture);
+	int rc = pack_resource(view, &p, texture);
 	texture->origin = size / 2.;
 	return rc;
 }
@@ -71,7 +90,7 @@ static int paint_circle(oshu::ui::osu &view, struct oshu_color *color, struct os
 	cairo_set_line_width(p.cr, 3);
 	cairo_stroke(p.cr);
 
-	int rc = oshu_finish_painting(&p, texture);
+	int rc = pack_resource(view, &p, texture);
 	texture->origin = size / 2.;
 	return rc;
 }
@@ -108,18 +127,17 @@ static void build_path(cairo_t *cr, struct oshu_slider *slider)
  * Paint the slider ticks. Preferably updating the ticks every time the slider
  * repeats. Also, clear the ticks as the slider rolls over them.
  */
-int osu_paint_slider(oshu::ui::osu &view, struct oshu_hit *hit)
+static int paint_slider(double zoom, double radius, struct oshu_hit *hit, struct oshu_painter *painter, oshu_point *origin)
 {
-	oshu_game *game = &view.game;
 	int start = SDL_GetTicks();
 	assert (hit->type & OSHU_SLIDER_HIT);
-	double radius = game->beatmap.difficulty.circle_radius;
 	oshu_point top_left, bottom_right;
 	oshu_path_bounding_box(&hit->slider.path, &top_left, &bottom_right);
 	oshu_size size = bottom_right - top_left + oshu_vector{2, 2} * radius;
 
-	struct oshu_painter p;
-	oshu_start_painting(view.display, size, &p);
+	if (oshu_start_offscreen_painting(zoom, size, painter) < 0)
+		return -1;
+	struct oshu_painter &p = *painter;
 
 	cairo_translate(p.cr, - std::real(top_left) + radius, - std::imag(top_left) + radius);
 	cairo_set_operator(p.cr, CAIRO_OPERATOR_SOURCE);
@@ -170,20 +188,155 @@ int osu_paint_slider(oshu::ui::osu &view, struct oshu_hit *hit)
 	cairo_stroke(p.cr);
 
 	cairo_pattern_destroy(pattern);
+	oshu_end_offscreen_painting(painter);
+
+	*origin = hit->p - top_left + oshu_vector{1, 1} * radius;
+	oshu_log_verbose("slider drawn in %.3f seconds", (SDL_GetTicks() - start) / 1000.);
+	return 0;
+}
 
-	hit->texture = (oshu_texture*) calloc(1, sizeof(*hit->texture));
+/**
+ * Pack a slider painted by #paint_slider in the atlas, as the hit's texture.
+ *
+ * The hit may already have an empty texture object, if the atlas evicted it.
+ *
+ * The slider is kept in the atlas until it ends. Evicting an upcoming slider
+ * would only have it painted again, evicting another one in turn.
+ */
+static int upload_slider(oshu::ui::osu &view, struct oshu_hit *hit, struct oshu_painter *painter, oshu_point origin)
+{
+	if (!hit->texture)
+		hit->texture = (oshu_texture*) calloc(1, sizeof(*hit->texture));
 	assert (hit->texture != NULL);
-	if (oshu_finish_painting(&p, hit->texture) < 0) {
+	if (oshu_pack_painting(painter, &view.atlas, OSHU_EVICTABLE, hit->texture) < 0) {
 		free(hit->texture);
 		hit->texture = NULL;
 		return -1;
 	}
-
-	hit->texture->origin = hit->p - top_left + oshu_vector{1, 1} * radius;
-	oshu_log_verbose("slider drawn in %.3f seconds", (SDL_GetTicks() - start) / 1000.);
+	hit->texture->origin = origin;
+	if (hit->texture->region)
+		hit->texture->region->expiry = oshu_hit_end_time(hit);
 	return 0;
 }
 
+/**
+ * Upload a slider from the background painters, or discard it if it's too
+ * late for it to be shown.
+ */
+static void upload_painted(oshu::ui::osu &view, oshu::ui::painted_slider &painted)
+{
+	struct oshu_hit *hit = painted.hit;
+	view.painting.erase(hit);
+	if (!painted.ok)
+		return;
+	if (is_painted(hit) || (hit->state != OSHU_INITIAL_HIT && hit->state != OSHU_SLIDING_HIT))
+		oshu_discard_painting(&painted.painter);
+	else
+		upload_slider(view, hit, &painted.painter, painted.origin);
+}
+
+/**
+ * When a slider that's still being painted in the background becomes visible,
+ * don't paint it again. Either it's done and it's uploaded right away, or the
+ * caller skips it for a frame.
+ */
+static int collect_painted(oshu::ui::osu &view, struct oshu_hit *hit)
+{
+	oshu::ui::painted_slider painted;
+	{
+		std::lock_guard<std::mutex> lock(view.painted_lock);
+		auto it = view.painted.begin();
+		while (it != view.painted.end() && it->hit != hit)
+			++it;
+		if (it == view.painted.end())
+			return -1;
+		painted = *it;
+		view.painted.erase(it);
+	}
+	upload_painted(view, painted);
+	return is_painted(hit) ? 0 : -1;
+}
+
+int osu_paint_slider(oshu::ui::osu &view, struct oshu_hit *hit)
+{
+	if (is_painted(hit))
+		return 0;
+	if (view.painting.count(hit))
+		return collect_painted(view, hit);
+	struct oshu_painter p;
+	oshu_point origin;
+	double radius = view.game.beatmap.difficulty.circle_radius;
+	if (paint_slider(view.display->view.zoom, radius, hit, &p, &origin) < 0)
+		return -1;
+	return upload_slider(view, hit, &p, origin);
+}
+
+/**
+ * How many threads paint the sliders in the background.
+ *
+ * Two are enough to keep up with the densest maps, without competing too much
+ * with the game and audio threads.
+ */
+static const int slider_painters = 2;
+
+/**
+ * How long before a slider starts fading in it is sent to the painters, in
+ * seconds.
+ */
+static const double prepaint_ahead = 3.;
+
+/**
+ * How much time #osu_prepaint_sliders may spend uploading textures per frame,
+ * in seconds.
+ */
+static const double upload_budget = .002;
+
+void osu_prepaint_sliders(oshu::ui::osu &view)
+{
+	oshu_game *game = &view.game;
+	if (!view.painters)
+		view.painters.reset(new oshu::thread_pool(slider_painters));
+
+	/* 1. Upload what's ready. */
+	std::vector<oshu::ui::painted_slider> ready;
+	{
+		std::lock_guard<std::mutex> lock(view.painted_lock);
+		ready.swap(view.painted);
+	}
+	Uint64 start = SDL_GetPerformanceCounter();
+	Uint64 budget = upload_budget * SDL_GetPerformanceFrequency();
+	size_t done = 0;
+	while (done < ready.size() && SDL_GetPerformanceCounter() - start < budget)
+		upload_painted(view, ready[done++]);
+	if (done < ready.size()) {
+		std::lock_guard<std::mutex> lock(view.painted_lock);
+		view.painted.insert(view.painted.begin(), ready.begin() + done, ready.end());
+	}
+
+	/* 2. Send the upcoming sliders to the painters, unless there's no room
+	 *    left for them, in which case they'll be painted when shown. */
+	if (view.atlas.full)
+		return;
+	double zoom = view.display->view.zoom;
+	double radius = game->beatmap.difficulty.circle_radius;
+	double approach_time = game->beatmap.difficulty.approach_time;
+	double horizon = game->clock.now + approach_time + prepaint_ahead;
+	/* the visible ones are painted on the spot by the drawing routine */
+	struct oshu_hit *hit = oshu_look_hit_up(game, approach_time)->next;
+	for (; hit && hit->time < horizon; hit = hit->next) {
+		if (!(hit->type & OSHU_SLIDER_HIT) || is_painted(hit) || hit->state != OSHU_INITIAL_HIT)
+			continue;
+		if (!view.painting.insert(hit).second)
+			continue;
+		view.painters->submit([&view, hit, zoom, radius] {
+			oshu::ui::painted_slider painted {hit};
+			painted.ok = paint_slider(zoom, radius, hit, &painted.painter, &painted.origin) == 0;
+			std::lock_guard<std::mutex> lock(view.painted_lock);
+			view.painted.push_back(painted);
+		});
+	}
+}
+
 /**
  * \todo
  * It looks like cairo_fill with a pattern triggers jumps depending on
@@ -220,7 +373,7 @@ static int paint_slider_ball(oshu::ui::osu &view) {
 	cairo_pattern_destroy(pattern);
 
 	struct oshu_texture *texture = &view.slider_ball;
-	int rc = oshu_finish_painting(&p, texture);
+	int rc = pack_resource(view, &p, texture);
 	texture->origin = size / 2.;
 	return rc;
 }
@@ -251,7 +404,7 @@ static int paint_good_mark(oshu::ui::osu &view, int offset, struct oshu_texture
 	cairo_set_line_width(p.cr, 2);
 	cairo_stroke(p.cr);
 
-	int rc = oshu_finish_painting(&p, texture);
+	int rc = pack_resource(view, &p, texture);
 	texture->origin = size / 2.;
 	return rc;
 }
@@ -278,7 +431,7 @@ static int paint_bad_mark(oshu::ui::osu &view)
 	cairo_stroke(p.cr);
 
 	struct oshu_texture *texture = &view.bad_mark;
-	int rc = oshu_finish_painting(&p, texture);
+	int rc = pack_resource(view, &p, texture);
 	texture->origin = size / 2.;
 	return rc;
 }
@@ -307,7 +460,7 @@ static int paint_skip_mark(oshu::ui::osu &view)
 	cairo_stroke(p.cr);
 
 	struct oshu_texture *texture = &view.skip_mark;
-	int rc = oshu_finish_painting(&p, texture);
+	int rc = pack_resource(view, &p, texture);
 	texture->origin = size / 2.;
 	return rc;
 }
@@ -327,7 +480,7 @@ static int paint_connector(oshu::ui::osu &view)
 	cairo_fill(p.cr);
 
 	struct oshu_texture *texture = &view.connector;
-	int rc = oshu_finish_painting(&p, texture);
+	int rc = pack_resource(view, &p, texture);
 	texture->origin = size / 2.;
 	return rc;
 }
@@ -341,6 +494,7 @@ int osu_paint_resources(oshu::ui::osu &view)
 	oshu_game *game = &view.game;
 	int start = SDL_GetTicks();
 	oshu_log_debug("painting the textures");
+	oshu_create_atlas(view.display, &view.atlas);
 
 	/* Circle hits. */
 	assert (game->beatmap.color_count > 0);
@@ -372,6 +526,14 @@ int osu_paint_resources(oshu::ui::osu &view)
 void osu_free_resources(oshu::ui::osu &view)
 {
 	oshu_game *game = &view.game;
+	/* wait for the painters before touching the hits */
+	view.painters.reset();
+	for (oshu::ui::painted_slider &painted : view.painted) {
+		if (painted.ok)
+			oshu_discard_painting(&painted.painter);
+	}
+	view.painted.clear();
+	view.painting.clear();
 	if (view.circles) {
 		for (int i = 0; i < game->beatmap.color_count; ++i)
 			oshu_destroy_texture(&view.circles[i]);
@@ -392,4 +554,5 @@ void osu_free_resources(oshu::ui::osu &view)
 	oshu_destroy_texture(&view.bad_mark);
 	oshu_destroy_texture(&view.skip_mark);
 	oshu_destroy_texture(&view.connector);
+	oshu_destroy_atlas(&view.atlas);
 }
@@ -34,7 +34,7 @@ window::window(oshu_game &game)
 	if (game.beatmap.background_filename)
 		oshu_load_background(display, game.beatmap.background_filename, &background);
 	oshu_create_metadata_frame(display, &game.beatmap, &game.clock.system, &metadata);
-	oshu_create_audio_progress_bar(display, &game.audio.music, &audio_progress_bar);
+	oshu_create_audio_progress_bar(display, &game.audio, &audio_progress_bar);
 }
 
 window::~window()
@@ -66,6 +66,7 @@ void loop(window &w)
 
 	while (!game->stop) {
 		oshu_update_clock(game);
+		oshu_check_audio(&game->audio);
 		oshu_reset_view(w.display);
 		while (SDL_PollEvent(&event))
 			w.screen->on_event(w, &event);
@@ -0,0 +1,303 @@
+/**
+ * \file video/atlas.cc
+ * \ingroup video_atlas
+ */
+
+#include "video/atlas.h"
+
+#include "video/display.h"
+#include "video/texture.h"
+#include "core/log.h"
+
+#include <SDL2/SDL.h>
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+/**
+ * Width and height of a page, in pixels.
+ *
+ * 2048 is supported by every renderer we care about, and is enough for the
+ * biggest sliders in a 1080p window.
+ */
+static const int page_size = 2048;
+
+/**
+ * Default texture budget, in megabytes.
+ *
+ * That's 4 pages.
+ */
+static const int default_budget = 64;
+
+/**
+ * Read the texture budget from the OSHU_TEXTURE_BUDGET environment variable,
+ * and convert it to a number of pages.
+ */
+static int requested_pages()
+{
+	int page_bytes = page_size * page_size * 4;
+	const char *value = getenv("OSHU_TEXTURE_BUDGET");
+	int budget = default_budget;
+	if (value && *value) {
+		char *end;
+		long parsed = strtol(value, &end, 10);
+		if (*end || parsed < 0 || parsed > 1 << 16)
+			oshu_log_warning("invalid OSHU_TEXTURE_BUDGET value: %s", value);
+		else
+			budget = parsed;
+	}
+	return ((long) budget << 20) / page_bytes;
+}
+
+int oshu_create_atlas(struct oshu_display *display, struct oshu_atlas *atlas)
+{
+	atlas->display = display;
+	atlas->page_size = page_size;
+	atlas->max_pages = requested_pages();
+	atlas->pages.clear();
+	atlas->entries.clear();
+	atlas->clock = 0;
+	atlas->now = 0;
+	atlas->full = false;
+	if (atlas->max_pages == 0)
+		oshu_log_debug("the texture budget is too low for the atlas, disabling it");
+	else
+		oshu_log_debug("using up to %d texture atlas pages", atlas->max_pages);
+	return 0;
+}
+
+/**
+ * Empty the owner of an entry, and delete the entry.
+ */
+static void detach_entry(struct oshu_atlas_entry *entry)
+{
+	if (entry->owner) {
+		entry->owner->texture = NULL;
+		entry->owner->region = NULL;
+	}
+	oshu_free_atlas_entry(entry);
+}
+
+void oshu_destroy_atlas(struct oshu_atlas *atlas)
+{
+	while (!atlas->entries.empty())
+		detach_entry(atlas->entries.back());
+	for (struct oshu_atlas_page &page : atlas->pages)
+		SDL_DestroyTexture(page.texture);
+	atlas->pages.clear();
+}
+
+void oshu_tick_atlas(struct oshu_atlas *atlas, double now)
+{
+	++atlas->clock;
+	atlas->now = now;
+}
+
+void oshu_free_atlas_entry(struct oshu_atlas_entry *entry)
+{
+	struct oshu_atlas *atlas = entry->atlas;
+	struct oshu_atlas_page *page = &atlas->pages[entry->page];
+	struct oshu_atlas_shelf *shelf = &page->shelves[entry->shelf];
+	/* the region was the last one of the shelf, make room for the next */
+	if (entry->x + entry->w + 1 == shelf->x)
+		shelf->x = entry->x - 1;
+	if (--shelf->entries == 0) {
+		shelf->x = 0;
+		/* give the height of the empty shelves at the bottom back */
+		while (!page->shelves.empty() && page->shelves.back().entries == 0) {
+			page->top = page->shelves.back().y;
+			page->shelves.pop_back();
+		}
+	}
+	auto it = std::find(atlas->entries.begin(), atlas->entries.end(), entry);
+	assert (it != atlas->entries.end());
+	*it = atlas->entries.back();
+	atlas->entries.pop_back();
+	atlas->full = false;
+	delete entry;
+}
+
+/**
+ * Find room for a *w*×*h* region in a page, creating a shelf if necessary.
+ *
+ * Among the shelves that are tall enough, but not more than twice as tall as
+ * the region, the one that wastes the least height is chosen.
+ *
+ * \return The index of the shelf, or -1 if the page is full.
+ */
+static int place(struct oshu_atlas_page *page, int w, int h, int *x, int *y)
+{
+	int best = -1;
+	for (size_t i = 0; i < page->shelves.size(); ++i) {
+		struct oshu_atlas_shelf *shelf = &page->shelves[i];
+		if (shelf->height < h || shelf->height > 2 * h || page_size - shelf->x < w)
+			continue;
+		if (best < 0 || shelf->height < page->shelves[best].height)
+			best = i;
+	}
+	if (best < 0) {
+		if (page->top + h > page_size)
+			return -1;
+		page->shelves.push_back({.y = page->top, .height = h, .x = 0, .entries = 0});
+		page->top += h;
+		best = page->shelves.size() - 1;
+	}
+	struct oshu_atlas_shelf *shelf = &page->shelves[best];
+	*x = shelf->x;
+	*y = shelf->y;
+	shelf->x += w;
+	shelf->entries++;
+	return best;
+}
+
+static int add_page(struct oshu_atlas *atlas)
+{
+	struct oshu_atlas_page page {};
+	page.texture = SDL_CreateTexture(
+		atlas->display->renderer, SDL_PIXELFORMAT_ARGB8888,
+		SDL_TEXTUREACCESS_STATIC, page_size, page_size
+	);
+	if (!page.texture) {
+		oshu_log_warning("could not create an atlas page: %s", SDL_GetError());
+		return -1;
+	}
+	SDL_SetTextureBlendMode(page.texture, SDL_BLENDMODE_BLEND);
+	atlas->pages.push_back(page);
+	oshu_log_debug("allocated texture atlas page %d", (int) atlas->pages.size());
+	return 0;
+}
+
+/**
+ * The entries drawn during the current or the previous frame are kept, since
+ * they are most likely still on screen, and so are the ones that haven't
+ * expired yet, since they will be.
+ */
+static bool is_evictable(struct oshu_atlas *atlas, struct oshu_atlas_entry *entry)
+{
+	return (entry->flags & OSHU_EVICTABLE)
+	       && entry->last_use + 1 < atlas->clock
+	       && entry->expiry <= atlas->now;
+}
+
+/**
+ * Free the evictable entry that was drawn the longest time ago, along with
+ * the other evictable entries of its shelf.
+ *
+ * Since a shelf is only reused when it's empty, freeing a single entry in the
+ * middle of a shelf wouldn't make any room.
+ *
+ * \return -1 if no entry could be evicted.
+ */
+static int evict_oldest(struct oshu_atlas *atlas)
+{
+	struct oshu_atlas_entry *oldest = NULL;
+	for (struct oshu_atlas_entry *entry : atlas->entries) {
+		if (is_evictable(atlas, entry) && (!oldest || entry->last_use < oldest->last_use))
+			oldest = entry;
+	}
+	if (!oldest)
+		return -1;
+	int page = oldest->page, shelf = oldest->shelf;
+	std::vector<struct oshu_atlas_entry*> victims;
+	for (struct oshu_atlas_entry *entry : atlas->entries) {
+		if (entry->page == page && entry->shelf == shelf && is_evictable(atlas, entry))
+			victims.push_back(entry);
+	}
+	for (struct oshu_atlas_entry *entry : victims)
+		detach_entry(entry);
+	return 0;
+}
+
+/**
+ * Allocate a *w*×*h* region, adding pages or evicting older entries if
+ * needed.
+ */
+static struct oshu_atlas_entry* allocate(struct oshu_atlas *atlas, int w, int h)
+{
+	for (;;) {
+		for (size_t i = 0; i < atlas->pages.size(); ++i) {
+			int x, y;
+			int shelf = place(&atlas->pages[i], w, h, &x, &y);
+			if (shelf < 0)
+				continue;
+			struct oshu_atlas_entry *entry = new oshu_atlas_entry {};
+			entry->atlas = atlas;
+			entry->page = i;
+			entry->shelf = shelf;
+			entry->x = x + 1;
+			entry->y = y + 1;
+			entry->w = w - 2;
+			entry->h = h - 2;
+			entry->last_use = atlas->clock;
+			atlas->entries.push_back(entry);
+			return entry;
+		}
+		if ((int) atlas->pages.size() < atlas->max_pages) {
+			if (add_page(atlas) < 0)
+				return NULL;
+		} else if (evict_oldest(atlas) < 0) {
+			atlas->full = true;
+			return NULL;
+		}
+	}
+}
+
+/**
+ * Make the border of a region transparent, since it may contain the pixels of
+ * an evicted entry.
+ */
+static void clear_border(struct SDL_Texture *texture, struct oshu_atlas_entry *entry)
+{
+	static std::vector<Uint32> zeros;
+	int w = entry->w + 2, h = entry->h + 2;
+	if ((int) zeros.size() < std::max(w, h))
+		zeros.resize(std::max(w, h));
+	int left = entry->x - 1, top = entry->y - 1;
+	SDL_Rect rows[] = {{left, top, w, 1}, {left, top + h - 1, w, 1}};
+	SDL_Rect columns[] = {{left, top, 1, h}, {left + w - 1, top, 1, h}};
+	for (SDL_Rect &row : rows)
+		SDL_UpdateTexture(texture, &row, zeros.data(), w * 4);
+	for (SDL_Rect &column : columns)
+		SDL_UpdateTexture(texture, &column, zeros.data(), 4);
+}
+
+/**
+ * Give the surface its own texture, when it can't go in the atlas.
+ */
+static int upload_alone(struct oshu_atlas *atlas, struct SDL_Surface *surface, struct oshu_texture *texture)
+{
+	texture->region = NULL;
+	texture->texture = SDL_CreateTextureFromSurface(atlas->display->renderer, surface);
+	if (!texture->texture) {
+		oshu_log_error("error uploading texture: %s", SDL_GetError());
+		return -1;
+	}
+	return 0;
+}
+
+int oshu_pack_surface(struct oshu_atlas *atlas, struct SDL_Surface *surface, int flags, struct oshu_texture *texture)
+{
+	if (surface->format->format != SDL_PIXELFORMAT_ARGB8888)
+		return upload_alone(atlas, surface, texture);
+	if (surface->w + 2 > page_size || surface->h + 2 > page_size || atlas->max_pages == 0)
+		return upload_alone(atlas, surface, texture);
+	struct oshu_atlas_entry *entry = allocate(atlas, surface->w + 2, surface->h + 2);
+	if (!entry)
+		return upload_alone(atlas, surface, texture);
+
+	struct SDL_Texture *page = atlas->pages[entry->page].texture;
+	SDL_Rect rect = {entry->x, entry->y, entry->w, entry->h};
+	if (SDL_UpdateTexture(page, &rect, surface->pixels, surface->pitch) < 0) {
+		oshu_log_warning("could not copy the texture into the atlas: %s", SDL_GetError());
+		oshu_free_atlas_entry(entry);
+		return upload_alone(atlas, surface, texture);
+	}
+	clear_border(page, entry);
+	entry->flags = flags;
+	entry->owner = texture;
+	texture->texture = page;
+	texture->region = entry;
+	return 0;
+}
@@ -0,0 +1,146 @@
+/**
+ * \file video/batch.cc
+ * \ingroup video_batch
+ */
+
+#include "video/batch.h"
+
+#include "video/display.h"
+#include "core/log.h"
+
+#include <SDL2/SDL.h>
+
+#include <assert.h>
+#include <string.h>
+
+void oshu_begin_batch(struct oshu_display *display, struct oshu_sprite_batch *batch)
+{
+	assert (display->batch == NULL);
+	if (!batch->display) {
+		batch->display = display;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+		batch->geometry = true;
+#else
+		batch->geometry = false;
+#endif
+	}
+	assert (batch->display == display);
+	display->batch = batch;
+	batch->frames++;
+}
+
+void oshu_batch_sprite(struct oshu_sprite_batch *batch, struct SDL_Texture *texture, const struct oshu_sprite *sprite)
+{
+	if (texture != batch->texture) {
+		oshu_flush_batch(batch);
+		batch->texture = texture;
+		SDL_QueryTexture(texture, NULL, NULL, &batch->texture_width, &batch->texture_height);
+	}
+	batch->sprites.push_back(*sprite);
+}
+
+/**
+ * Draw the sprites one by one, setting the texture's modulation for each.
+ */
+static void copy_sprites(struct oshu_sprite_batch *batch)
+{
+	SDL_Renderer *renderer = batch->display->renderer;
+	unsigned char current[4] = {255, 255, 255, 255};
+	for (struct oshu_sprite &sprite : batch->sprites) {
+		unsigned char *color = sprite.color;
+		if (memcmp(color, current, 4)) {
+			SDL_SetTextureColorMod(batch->texture, color[0], color[1], color[2]);
+			SDL_SetTextureAlphaMod(batch->texture, color[3]);
+			memcpy(current, color, 4);
+		}
+		SDL_Rect source = {sprite.sx, sprite.sy, sprite.sw, sprite.sh};
+		SDL_Rect dest = {(int) sprite.x, (int) sprite.y, (int) sprite.w, (int) sprite.h};
+		SDL_RenderCopy(renderer, batch->texture, &source, &dest);
+	}
+	SDL_SetTextureColorMod(batch->texture, 255, 255, 255);
+	SDL_SetTextureAlphaMod(batch->texture, 255);
+	batch->total_draw_calls += batch->sprites.size();
+}
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+/**
+ * Turn every sprite into two triangles, and draw them all at once.
+ *
+ * \return -1 if the renderer can't draw geometry.
+ */
+static int render_sprites(struct oshu_sprite_batch *batch)
+{
+	size_t count = batch->sprites.size();
+	batch->vertices.resize(4 * count);
+	/* the indices are the same for every flush, only append the new ones */
+	for (int i = batch->indices.size() / 6; i < (int) count; ++i) {
+		int quad[] = {0, 1, 2, 2, 3, 0};
+		for (int corner : quad)
+			batch->indices.push_back(4 * i + corner);
+	}
+
+	float tw = batch->texture_width, th = batch->texture_height;
+	struct oshu_vertex *v = batch->vertices.data();
+	for (struct oshu_sprite &sprite : batch->sprites) {
+		float left = sprite.sx / tw, right = (sprite.sx + sprite.sw) / tw;
+		float top = sprite.sy / th, bottom = (sprite.sy + sprite.sh) / th;
+		float x2 = sprite.x + sprite.w, y2 = sprite.y + sprite.h;
+		*v++ = {sprite.x, sprite.y, {}, left, top};
+		*v++ = {x2, sprite.y, {}, right, top};
+		*v++ = {x2, y2, {}, right, bottom};
+		*v++ = {sprite.x, y2, {}, left, bottom};
+		for (int i = 1; i <= 4; ++i)
+			memcpy((v - i)->color, sprite.color, 4);
+	}
+
+	v = batch->vertices.data();
+	int stride = sizeof(*v);
+	int rc = SDL_RenderGeometryRaw(
+		batch->display->renderer, batch->texture,
+		&v->x, stride, (const SDL_Color*) v->color, stride, &v->u, stride,
+		4 * count, batch->indices.data(), 6 * count, sizeof(int)
+	);
+	if (rc == 0)
+		batch->total_draw_calls++;
+	return rc;
+}
+#endif
+
+void oshu_flush_batch(struct oshu_sprite_batch *batch)
+{
+	if (batch->sprites.empty())
+		return;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+	if (batch->geometry && render_sprites(batch) < 0) {
+		oshu_log_warning("could not render geometry: %s", SDL_GetError());
+		oshu_log_warning("drawing the sprites one by one from now on");
+		batch->geometry = false;
+	}
+#endif
+	if (!batch->geometry)
+		copy_sprites(batch);
+	batch->total_sprites += batch->sprites.size();
+	batch->sprites.clear();
+}
+
+void oshu_end_batch(struct oshu_display *display)
+{
+	struct oshu_sprite_batch *batch = display->batch;
+	assert (batch != NULL);
+	oshu_flush_batch(batch);
+	/* the texture may be destroyed before the next frame */
+	batch->texture = NULL;
+	display->batch = NULL;
+}
+
+void oshu_destroy_batch(struct oshu_sprite_batch *batch)
+{
+	if (batch->frames > 0) {
+		oshu_log_debug(
+			"drew %.1f sprites per frame in %.1f draw calls",
+			(double) batch->total_sprites / batch->frames,
+			(double) batch->total_draw_calls / batch->frames
+		);
+	}
+	*batch = {};
+}
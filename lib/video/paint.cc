@@ -5,13 +5,114 @@
 
 #include "video/paint.h"
 
+#include "video/atlas.h"
 #include "video/display.h"
+#include "video/pixels.h"
 #include "video/texture.h"
 #include "core/log.h"
 
 #include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <SDL2/SDL.h>
 
+#include <mutex>
+#include <vector>
+
+/**
+ * How many bytes of pixel buffers may stay in the #scratch pool, waiting for
+ * the next painting.
+ *
+ * That's enough for two big sliders in a 1440p window, and the two painter
+ * threads of the osu! mode.
+ */
+static const size_t scratch_budget = 24 << 20;
+
+/**
+ * Buffer sizes are rounded up to this, to improve their reuse.
+ */
+static const size_t scratch_granularity = 64 << 10;
+
+struct scratch_buffer {
+	void *data;
+	size_t size;
+};
+
+/**
+ * Pool of pixel buffers for the painters, shared by every thread.
+ *
+ * Most textures are painted once and uploaded right away, so the same few
+ * buffers can be recycled instead of being allocated for every painting.
+ */
+static struct scratch_pool {
+	std::mutex lock;
+	/**
+	 * The buffers nobody uses, the most recently released last.
+	 */
+	std::vector<struct scratch_buffer> idle;
+	size_t idle_size;
+	~scratch_pool()
+	{
+		for (struct scratch_buffer &buffer : idle)
+			free(buffer.data);
+	}
+} scratch;
+
+/**
+ * Get a zero-filled buffer of at least *size* bytes from the #scratch pool,
+ * or allocate a new one.
+ *
+ * The smallest idle buffer big enough is picked.
+ */
+static struct scratch_buffer acquire_scratch(size_t size)
+{
+	size = (size + scratch_granularity - 1) / scratch_granularity * scratch_granularity;
+	struct scratch_buffer buffer = {NULL, 0};
+	{
+		std::lock_guard<std::mutex> lock(scratch.lock);
+		auto best = scratch.idle.end();
+		for (auto it = scratch.idle.begin(); it != scratch.idle.end(); ++it) {
+			if (it->size >= size && (best == scratch.idle.end() || it->size < best->size))
+				best = it;
+		}
+		if (best != scratch.idle.end()) {
+			buffer = *best;
+			scratch.idle.erase(best);
+			scratch.idle_size -= buffer.size;
+		}
+	}
+	if (buffer.data) {
+		/* cairo expects a clear surface */
+		memset(buffer.data, 0, size);
+	} else {
+		buffer.data = calloc(1, size);
+		buffer.size = buffer.data ? size : 0;
+	}
+	return buffer;
+}
+
+/**
+ * Give a buffer back to the #scratch pool, freeing the oldest idle buffers if
+ * the pool exceeds the #scratch_budget.
+ */
+static void release_scratch(struct scratch_buffer buffer)
+{
+	std::vector<void*> evicted;
+	{
+		std::lock_guard<std::mutex> lock(scratch.lock);
+		scratch.idle.push_back(buffer);
+		scratch.idle_size += buffer.size;
+		while (scratch.idle_size > scratch_budget) {
+			evicted.push_back(scratch.idle.front().data);
+			scratch.idle_size -= scratch.idle.front().size;
+			scratch.idle.erase(scratch.idle.begin());
+		}
+	}
+	for (void *data : evicted)
+		free(data);
+}
+
 static void destroy_painter(struct oshu_painter *painter)
 {
 	if (painter->cr) {
@@ -26,21 +127,41 @@ static void destroy_painter(struct oshu_painter *painter)
 		SDL_FreeSurface(painter->destination);
 		painter->destination = NULL;
 	}
+	if (painter->scratch) {
+		release_scratch({painter->scratch, painter->scratch_size});
+		painter->scratch = NULL;
+	}
 }
 
 int oshu_start_painting(struct oshu_display *display, oshu_size size, struct oshu_painter *painter)
+{
+	if (oshu_start_offscreen_painting(display->view.zoom, size, painter) < 0)
+		return -1;
+	painter->display = display;
+	return 0;
+}
+
+int oshu_start_offscreen_painting(double zoom, oshu_size size, struct oshu_painter *painter)
 {
 	cairo_status_t s;
 	memset(painter, 0, sizeof(*painter));
-	painter->display = display;
 	painter->size = size;
-
-	double zoom = display->view.zoom;
 	size *= zoom;
+	int width = std::real(size), height = std::imag(size);
+	struct scratch_buffer buffer;
+
+	/* 1. Pixels */
+	buffer = acquire_scratch((size_t) width * height * 4);
+	if (!buffer.data) {
+		oshu_log_error("could not allocate a %d×%d painting surface", width, height);
+		goto fail;
+	}
+	painter->scratch = buffer.data;
+	painter->scratch_size = buffer.size;
 
-	/* 1. SDL */
-	painter->destination = SDL_CreateRGBSurface(
-		0, std::real(size), std::imag(size), 32,
+	/* 2. SDL */
+	painter->destination = SDL_CreateRGBSurfaceFrom(
+		buffer.data, width, height, 32, width * 4,
 		0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
 	if (!painter->destination) {
 		oshu_log_error("could not create a painting surface: %s", SDL_GetError());
@@ -51,7 +172,7 @@ int oshu_start_painting(struct oshu_display *display, oshu_size size, struct osh
 		goto fail;
 	}
 
-	/* 2. Cairo surface */
+	/* 3. Cairo surface */
 	painter->surface = cairo_image_surface_create_for_data(
 		(unsigned char*) painter->destination->pixels, CAIRO_FORMAT_ARGB32,
 		std::real(size), std::imag(size), painter->destination->pitch);
@@ -61,7 +182,7 @@ int oshu_start_painting(struct oshu_display *display, oshu_size size, struct osh
 		goto fail;
 	}
 
-	/* 3. Cairo context */
+	/* 4. Cairo context */
 	painter->cr = cairo_create(painter->surface);
 	s = cairo_status(painter->cr);
 	if (s != CAIRO_STATUS_SUCCESS) {
@@ -87,32 +208,83 @@ fail:
  */
 static void unpremultiply(SDL_Surface *surface)
 {
-	uint8_t *pixels = (uint8_t*) surface->pixels;
 	assert (surface->pitch % 4 == 0);
 	assert (surface->pitch == 4 * surface->w);
-	uint8_t *end = pixels + surface->h * surface->pitch;
-	for (uint8_t *c = pixels; c < end; c += 4) {
-		uint8_t alpha = c[3];
-		if (alpha == 0)
-			continue;
-		c[0] = (unsigned int) c[0] * 255 / alpha;
-		c[1] = (unsigned int) c[1] * 255 / alpha;
-		c[2] = (unsigned int) c[2] * 255 / alpha;
-	}
+	oshu_unpremultiply((uint32_t*) surface->pixels, (size_t) surface->w * surface->h);
 }
 
-int oshu_finish_painting(struct oshu_painter *painter, struct oshu_texture *texture)
+void oshu_end_offscreen_painting(struct oshu_painter *painter)
 {
-	int rc = 0;
+	/* flush the drawing and drop the cairo objects, keeping the pixels */
+	cairo_destroy(painter->cr);
+	painter->cr = NULL;
+	cairo_surface_destroy(painter->surface);
+	painter->surface = NULL;
 	unpremultiply(painter->destination);
 	SDL_UnlockSurface(painter->destination);
-	texture->size = painter->size;
-	texture->origin = 0;
-	texture->texture = SDL_CreateTextureFromSurface(painter->display->renderer, painter->destination);
-	if (!texture->texture) {
+}
+
+/**
+ * Tell whether the SDL texture of *texture* can receive the painter's pixels
+ * as is.
+ */
+static bool is_reusable(struct oshu_texture *texture, SDL_Surface *surface)
+{
+	if (!texture->texture || texture->region)
+		return false;
+	Uint32 format;
+	int w, h;
+	if (SDL_QueryTexture(texture->texture, &format, NULL, &w, &h) < 0)
+		return false;
+	return format == SDL_PIXELFORMAT_ARGB8888 && w == surface->w && h == surface->h;
+}
+
+int oshu_upload_painting(struct oshu_painter *painter, struct oshu_display *display, struct oshu_texture *texture)
+{
+	SDL_Surface *surface = painter->destination;
+	if (!is_reusable(texture, surface)) {
+		oshu_destroy_texture(texture);
+		texture->texture = SDL_CreateTexture(
+			display->renderer, SDL_PIXELFORMAT_ARGB8888,
+			SDL_TEXTUREACCESS_STATIC, surface->w, surface->h
+		);
+		if (!texture->texture) {
+			oshu_log_error("error creating texture: %s", SDL_GetError());
+			goto fail;
+		}
+		SDL_SetTextureBlendMode(texture->texture, SDL_BLENDMODE_BLEND);
+	}
+	if (SDL_UpdateTexture(texture->texture, NULL, surface->pixels, surface->pitch) < 0) {
 		oshu_log_error("error uploading texture: %s", SDL_GetError());
-		rc = -1;
+		oshu_destroy_texture(texture);
+		goto fail;
 	}
+	texture->size = painter->size;
+	texture->origin = 0;
+	destroy_painter(painter);
+	return 0;
+
+fail:
+	destroy_painter(painter);
+	return -1;
+}
+
+int oshu_pack_painting(struct oshu_painter *painter, struct oshu_atlas *atlas, int flags, struct oshu_texture *texture)
+{
+	texture->size = painter->size;
+	texture->origin = 0;
+	int rc = oshu_pack_surface(atlas, painter->destination, flags, texture);
 	destroy_painter(painter);
 	return rc;
 }
+
+void oshu_discard_painting(struct oshu_painter *painter)
+{
+	destroy_painter(painter);
+}
+
+int oshu_finish_painting(struct oshu_painter *painter, struct oshu_texture *texture)
+{
+	oshu_end_offscreen_painting(painter);
+	return oshu_upload_painting(painter, painter->display, texture);
+}
@@ -0,0 +1,112 @@
+/**
+ * \file video/pixels.cc
+ * \ingroup video_pixels
+ */
+
+#include "video/pixels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define OSHU_PIXELS_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * Fixed-point reciprocals of the alpha values, such that
+ * `c * 255 / alpha == (c * reciprocals[alpha]) >> 16` for every `c <= alpha`.
+ *
+ * The reciprocal of 0 is 0, which keeps transparent pixels black.
+ */
+static struct reciprocal_table {
+	uint32_t values[256];
+	reciprocal_table()
+	{
+		values[0] = 0;
+		for (uint32_t alpha = 1; alpha < 256; ++alpha)
+			values[alpha] = (255 * 65536 + alpha - 1) / alpha;
+	}
+} reciprocals;
+
+static void unpremultiply_c(uint32_t *pixels, size_t count)
+{
+	for (size_t i = 0; i < count; ++i) {
+		uint32_t p = pixels[i];
+		uint32_t alpha = p >> 24;
+		uint32_t r = reciprocals.values[alpha];
+		uint32_t red = ((p >> 16 & 0xff) * r) >> 16;
+		uint32_t green = ((p >> 8 & 0xff) * r) >> 16;
+		uint32_t blue = ((p & 0xff) * r) >> 16;
+		red = red < 255 ? red : 255;
+		green = green < 255 ? green : 255;
+		blue = blue < 255 ? blue : 255;
+		pixels[i] = alpha << 24 | red << 16 | green << 8 | blue;
+	}
+}
+
+#ifdef OSHU_PIXELS_X86
+
+__attribute__((target("sse4.1")))
+static void unpremultiply_sse41(uint32_t *pixels, size_t count)
+{
+	const __m128i byte = _mm_set1_epi32(0xff);
+	const __m128i alpha = _mm_set1_epi32(0xff000000);
+	const uint32_t *table = reciprocals.values;
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		uint32_t *q = pixels + i;
+		__m128i p = _mm_loadu_si128((__m128i*) q);
+		__m128i r = _mm_set_epi32(table[q[3] >> 24], table[q[2] >> 24], table[q[1] >> 24], table[q[0] >> 24]);
+		__m128i result = _mm_and_si128(p, alpha);
+		for (int shift = 0; shift < 24; shift += 8) {
+			__m128i c = _mm_and_si128(_mm_srli_epi32(p, shift), byte);
+			c = _mm_min_epu32(_mm_srli_epi32(_mm_mullo_epi32(c, r), 16), byte);
+			result = _mm_or_si128(result, _mm_slli_epi32(c, shift));
+		}
+		_mm_storeu_si128((__m128i*) q, result);
+	}
+	unpremultiply_c(pixels + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void unpremultiply_avx2(uint32_t *pixels, size_t count)
+{
+	const __m256i byte = _mm256_set1_epi32(0xff);
+	const __m256i alpha = _mm256_set1_epi32(0xff000000);
+	const int *table = (const int*) reciprocals.values;
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i p = _mm256_loadu_si256((__m256i*) (pixels + i));
+		__m256i r = _mm256_i32gather_epi32(table, _mm256_srli_epi32(p, 24), 4);
+		__m256i result = _mm256_and_si256(p, alpha);
+		for (int shift = 0; shift < 24; shift += 8) {
+			__m256i c = _mm256_and_si256(_mm256_srli_epi32(p, shift), byte);
+			c = _mm256_min_epu32(_mm256_srli_epi32(_mm256_mullo_epi32(c, r), 16), byte);
+			result = _mm256_or_si256(result, _mm256_slli_epi32(c, shift));
+		}
+		_mm256_storeu_si256((__m256i*) (pixels + i), result);
+	}
+	unpremultiply_c(pixels + i, count - i);
+}
+
+#endif
+
+/**
+ * Pick the best loop the CPU supports.
+ */
+static void (*select_unpremultiply())(uint32_t*, size_t)
+{
+#ifdef OSHU_PIXELS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return unpremultiply_avx2;
+	if (__builtin_cpu_supports("sse4.1"))
+		return unpremultiply_sse41;
+#endif
+	return unpremultiply_c;
+}
+
+static void (*const unpremultiply_kernel)(uint32_t*, size_t) = select_unpremultiply();
+
+void oshu_unpremultiply(uint32_t *pixels, size_t count)
+{
+	unpremultiply_kernel(pixels, count);
+}
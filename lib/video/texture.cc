@@ -5,6 +5,8 @@
 
 #include "video/texture.h"
 
+#include "video/atlas.h"
+#include "video/batch.h"
 #include "video/display.h"
 #include "core/log.h"
 
@@ -18,6 +20,7 @@ int oshu_load_texture(struct oshu_display *display, const char *filename, struct
 		return -1;
 	}
 	texture->origin = 0;
+	texture->region = NULL;
 	int tw, th;
 	SDL_QueryTexture(texture->texture, NULL, NULL, &tw, &th);
 	texture->size = oshu_size(tw, th);
@@ -26,13 +29,17 @@ int oshu_load_texture(struct oshu_display *display, const char *filename, struct
 
 void oshu_destroy_texture(struct oshu_texture *texture)
 {
-	if (texture->texture) {
+	if (texture->region) {
+		oshu_free_atlas_entry(texture->region);
+		texture->region = NULL;
+		texture->texture = NULL;
+	} else if (texture->texture) {
 		SDL_DestroyTexture(texture->texture);
 		texture->texture = NULL;
 	}
 }
 
-void oshu_draw_scaled_texture(struct oshu_display *display, struct oshu_texture *texture, oshu_point p, double ratio)
+void oshu_draw_faded_texture(struct oshu_display *display, struct oshu_texture *texture, oshu_point p, double ratio, double opacity)
 {
 	oshu_point top_left = oshu_project(&display->view, p - texture->origin * ratio);
 	oshu_size size = texture->size * ratio * display->view.zoom;
@@ -40,7 +47,38 @@ void oshu_draw_scaled_texture(struct oshu_display *display, struct oshu_texture
 		.x = (int) std::real(top_left), .y = (int) std::imag(top_left),
 		.w = (int) std::real(size), .h = (int) std::imag(size),
 	};
-	SDL_RenderCopy(display->renderer, texture->texture, NULL, &dest);
+	SDL_Rect source;
+	struct oshu_atlas_entry *region = texture->region;
+	if (region) {
+		source = {region->x, region->y, region->w, region->h};
+		region->last_use = region->atlas->clock;
+	}
+	unsigned char alpha = opacity * 255;
+	if (display->batch) {
+		struct oshu_sprite sprite = {
+			.x = (float) std::real(top_left), .y = (float) std::imag(top_left),
+			.w = (float) std::real(size), .h = (float) std::imag(size),
+			.color = {255, 255, 255, alpha},
+		};
+		if (region) {
+			sprite.sx = source.x; sprite.sy = source.y;
+			sprite.sw = source.w; sprite.sh = source.h;
+		} else {
+			SDL_QueryTexture(texture->texture, NULL, NULL, &sprite.sw, &sprite.sh);
+		}
+		oshu_batch_sprite(display->batch, texture->texture, &sprite);
+		return;
+	}
+	if (alpha < 255)
+		SDL_SetTextureAlphaMod(texture->texture, alpha);
+	SDL_RenderCopy(display->renderer, texture->texture, region ? &source : NULL, &dest);
+	if (alpha < 255)
+		SDL_SetTextureAlphaMod(texture->texture, 255);
+}
+
+void oshu_draw_scaled_texture(struct oshu_display *display, struct oshu_texture *texture, oshu_point p, double ratio)
+{
+	oshu_draw_faded_texture(display, texture, p, ratio, 1.);
 }
 
 void oshu_draw_texture(struct oshu_display *display, struct oshu_texture *texture, oshu_point p)
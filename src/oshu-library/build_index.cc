@@ -14,19 +14,29 @@
 #include "core/log.h"
 #include "library/beatmaps.h"
 #include "library/html.h"
+#include "library/manifest.h"
 
 #include "./command.h"
 
 enum option_values {
+	OPT_JOBS = 'j',
 	OPT_VERBOSE = 'v',
 };
 
 static struct option options[] = {
+	{"jobs", required_argument, 0, OPT_JOBS},
 	{"verbose", no_argument, 0, OPT_VERBOSE},
 	{0, 0, 0, 0},
 };
 
-static const char *flags = "v";
+static const char *flags = "j:v";
+
+/**
+ * Number of threads scanning the beatmaps, set with `-j`.
+ *
+ * 0 means as many as the hardware supports.
+ */
+static int jobs = 0;
 
 static void ensure_directory(const std::string &path)
 {
@@ -75,7 +85,9 @@ static void do_build_index()
 	ensure_directory(home);
 	ensure_directory(home + "/web");
 	change_directory(home + "/web");
-	auto sets = oshu::library::find_beatmap_sets("../beatmaps");
+	oshu::library::manifest manifest = oshu::library::read_manifest("../manifest");
+	auto sets = oshu::library::find_beatmap_sets("../beatmaps", jobs, &manifest);
+	oshu::library::write_manifest(manifest, "../manifest");
 	std::ofstream index("index.html");
 	oshu::library::html::generate_beatmap_set_listing(sets, index);
 	std::cout << home << "/web/index.html" << std::endl;
@@ -88,13 +100,22 @@ static int run(int argc, char **argv)
 		if (c == -1)
 			break;
 		switch (c) {
+		case OPT_JOBS:
+			jobs = std::atoi(optarg);
+			if (jobs <= 0) {
+				std::cerr << "Invalid number of jobs: " << optarg << std::endl;
+				return 2;
+			}
+			break;
 		case OPT_VERBOSE:
 			--oshu::log::priority;
 			break;
+		default:
+			return 2;
 		}
 	}
 	if (argc - optind != 0) {
-		std::cerr << "Usage: oshu-library build-index [-v]" << std::endl;
+		std::cerr << "Usage: oshu-library build-index [-v] [-j JOBS]" << std::endl;
 		std::cerr << "       oshu-library --help" << std::endl;
 		return 2;
 	}
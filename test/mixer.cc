@@ -0,0 +1,104 @@
+#include "audio/mixer.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+static std::mt19937 rng {42};
+
+/**
+ * The straightforward mixer: one pass per input, then one pass to clip.
+ */
+static void reference_mix(float *samples, int nb_samples, const oshu_mix_input *inputs, int count)
+{
+	for (int i = 0; i < count; ++i) {
+		float *output = samples + inputs[i].offset * 2;
+		for (int j = 0; j < inputs[i].length * 2; ++j)
+			output[j] = std::fma(inputs[i].samples[j], inputs[i].volume, output[j]);
+	}
+	for (int i = 0; i < nb_samples * 2; ++i) {
+		if (samples[i] > 1.)
+			samples[i] = 1.;
+		else if (samples[i] < -1.)
+			samples[i] = -1.;
+	}
+}
+
+static std::vector<float> random_samples(int nb_samples)
+{
+	std::uniform_real_distribution<float> amplitude(-.8, .8);
+	std::vector<float> samples(nb_samples * 2);
+	for (float &s : samples)
+		s = amplitude(rng);
+	return samples;
+}
+
+/**
+ * Generate up to 17 inputs, like the 16 effect tracks and the looping track.
+ */
+static std::vector<oshu_mix_input> random_inputs(const std::vector<float> &source, int nb_samples)
+{
+	std::vector<oshu_mix_input> inputs(std::uniform_int_distribution<int>(0, 17)(rng));
+	for (oshu_mix_input &input : inputs) {
+		input.offset = std::uniform_int_distribution<int>(0, nb_samples - 1)(rng);
+		input.length = std::uniform_int_distribution<int>(1, nb_samples - input.offset)(rng);
+		input.samples = source.data() + std::uniform_int_distribution<int>(0, source.size() / 2 - input.length)(rng) * 2;
+		input.volume = std::uniform_real_distribution<float>(0, 1)(rng);
+	}
+	return inputs;
+}
+
+static int check_mix()
+{
+	std::vector<float> source = random_samples(4096);
+	for (int i = 0; i < 1000; ++i) {
+		int nb_samples = std::uniform_int_distribution<int>(1, 2048)(rng);
+		std::vector<oshu_mix_input> inputs = random_inputs(source, nb_samples);
+		std::vector<float> expected = random_samples(nb_samples);
+		std::vector<float> mixed = expected;
+		reference_mix(expected.data(), nb_samples, inputs.data(), inputs.size());
+		oshu_mix(mixed.data(), nb_samples, inputs.data(), inputs.size());
+		for (int j = 0; j < nb_samples * 2; ++j) {
+			if (std::fabs(mixed[j] - expected[j]) > 1e-5) {
+				std::cerr << "mixed sample " << j << " is " << mixed[j] << ", expected " << expected[j] << std::endl;
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+/**
+ * Time both mixers on a 512-sample buffer with 17 full-length inputs, which
+ * is the worst case of the audio callback.
+ */
+static void benchmark()
+{
+	const int nb_samples = 512;
+	const int rounds = 20000;
+	std::vector<float> source = random_samples(nb_samples);
+	std::vector<oshu_mix_input> inputs(17, oshu_mix_input {source.data(), 0, nb_samples, .5});
+	std::vector<float> buffer = random_samples(nb_samples);
+	auto time = [&](void (*mix)(float*, int, const oshu_mix_input*, int)) {
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < rounds; ++i)
+			mix(buffer.data(), nb_samples, inputs.data(), inputs.size());
+		std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+		return elapsed.count() / rounds;
+	};
+	double reference = time(reference_mix);
+	double optimized = time(oshu_mix);
+	std::cout << "reference mixer: " << reference << " µs per buffer" << std::endl;
+	std::cout << "oshu_mix: " << optimized << " µs per buffer" << std::endl;
+}
+
+int main()
+{
+	int failures = check_mix();
+	benchmark();
+	if (failures > 0)
+		std::cerr << "Total: " << failures << " failed tests." << std::endl;
+	return failures;
+}
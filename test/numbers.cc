@@ -0,0 +1,99 @@
+#include "core/number.h"
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+#include <iostream>
+#include <random>
+#include <string>
+
+static std::mt19937 rng {42};
+
+static int random_int(int min, int max)
+{
+	return std::uniform_int_distribution<int>(min, max)(rng);
+}
+
+static std::string random_digits(int max)
+{
+	std::string digits;
+	int count = random_int(0, max);
+	for (int i = 0; i < count; ++i)
+		digits += '0' + random_int(0, 9);
+	return digits;
+}
+
+/**
+ * Generate something that looks like a number, or sometimes not quite.
+ */
+static std::string random_number()
+{
+	static const char *prefixes[] = {"", "", "", "-", "+", " ", "\t-", "0x", "inf", "nan", "."};
+	static const char *suffixes[] = {"", "", ",", ":12", "|", "e", "e+", "x"};
+	std::string str = prefixes[random_int(0, 10)];
+	str += random_digits(random_int(0, 1) ? 4 : 25);
+	if (random_int(0, 1)) {
+		str += '.';
+		str += random_digits(random_int(0, 1) ? 4 : 25);
+	}
+	if (random_int(0, 3) == 0) {
+		str += "eE"[random_int(0, 1)];
+		str += std::string("+-").substr(random_int(0, 2), 1);
+		str += random_digits(3);
+	}
+	str += suffixes[random_int(0, 7)];
+	return str;
+}
+
+static int check_double(const std::string &str)
+{
+	char *expected_end, *end;
+	double expected = std::strtod(str.c_str(), &expected_end);
+	double value = oshu_strtod(str.c_str(), &end);
+	bool same_value = std::memcmp(&value, &expected, sizeof(value)) == 0 || (value != value && expected != expected);
+	if (same_value && end == expected_end)
+		return 0;
+	std::cerr.precision(17);
+	std::cerr << "oshu_strtod(\"" << str << "\") = " << value << " (" << end - str.c_str() << " characters)"
+	          << ", expected " << expected << " (" << expected_end - str.c_str() << " characters)" << std::endl;
+	return 1;
+}
+
+static int check_int(const std::string &str)
+{
+	char *expected_end, *end;
+	long long expected = std::strtoll(str.c_str(), &expected_end, 10);
+	if (expected < INT_MIN)
+		expected = INT_MIN;
+	if (expected > INT_MAX)
+		expected = INT_MAX;
+	int value = oshu_strtoi(str.c_str(), &end);
+	if (value == expected && end == expected_end)
+		return 0;
+	std::cerr << "oshu_strtoi(\"" << str << "\") = " << value << " (" << end - str.c_str() << " characters)"
+	          << ", expected " << expected << " (" << expected_end - str.c_str() << " characters)" << std::endl;
+	return 1;
+}
+
+int main()
+{
+	int failures = 0;
+	const char *samples[] = {
+		"0", "-0", "256", "192,", "-1.5", "1e", "1e+", "1.e3", ".5", "-.", "",
+		"0.1", "0.30000000000000004", "9007199254740993", "1e22", "1e23", "2.2250738585072014e-308",
+		"123456789012345678901234567890", "0.000000000000000000000000000001", "2147483648", "-2147483649",
+	};
+	for (const char *sample : samples) {
+		failures += check_double(sample);
+		failures += check_int(sample);
+	}
+	for (int i = 0; i < 200000 && failures < 10; ++i) {
+		std::string str = random_number();
+		failures += check_double(str);
+		failures += check_int(str);
+	}
+	if (failures > 0)
+		std::cerr << "Total: " << failures << " failed tests." << std::endl;
+	return failures;
+}
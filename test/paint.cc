@@ -0,0 +1,111 @@
+#include "video/pixels.h"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+static std::mt19937 rng {42};
+
+/**
+ * The original loop, with three divisions per pixel.
+ */
+static void reference_unpremultiply(uint32_t *pixels, size_t count)
+{
+	uint8_t *end = (uint8_t*) (pixels + count);
+	for (uint8_t *c = (uint8_t*) pixels; c < end; c += 4) {
+		uint8_t alpha = c[3];
+		if (alpha == 0)
+			continue;
+		c[0] = (unsigned int) c[0] * 255 / alpha;
+		c[1] = (unsigned int) c[1] * 255 / alpha;
+		c[2] = (unsigned int) c[2] * 255 / alpha;
+	}
+}
+
+/**
+ * Generate premultiplied pixels, like Cairo would, with a fair share of fully
+ * transparent and fully opaque ones.
+ */
+static std::vector<uint32_t> random_pixels(size_t count)
+{
+	std::vector<uint32_t> pixels(count);
+	std::uniform_int_distribution<int> kind(0, 3);
+	std::uniform_int_distribution<int> any(0, 255);
+	for (uint32_t &p : pixels) {
+		int k = kind(rng);
+		uint32_t alpha = k == 0 ? 0 : k == 1 ? 255 : any(rng);
+		p = alpha << 24;
+		for (int shift = 0; shift < 24; shift += 8)
+			p |= std::uniform_int_distribution<uint32_t>(0, alpha)(rng) << shift;
+	}
+	return pixels;
+}
+
+static int check_unpremultiply()
+{
+	int failures = 0;
+	/* every valid combination of alpha and color */
+	std::vector<uint32_t> all;
+	for (uint32_t alpha = 0; alpha < 256; ++alpha) {
+		for (uint32_t c = 0; c <= alpha; ++c)
+			all.push_back(alpha << 24 | c << 16 | (alpha - c) << 8 | c / 2);
+	}
+	std::vector<uint32_t> expected = all;
+	reference_unpremultiply(expected.data(), expected.size());
+	oshu_unpremultiply(all.data(), all.size());
+	for (size_t i = 0; i < all.size(); ++i) {
+		if (all[i] != expected[i]) {
+			std::cerr << std::hex << "unpremultiplied pixel is " << all[i] << ", expected " << expected[i] << std::dec << std::endl;
+			++failures;
+			break;
+		}
+	}
+	/* odd sizes, to check the leftovers of the vectorized loops */
+	for (size_t count = 0; count < 40; ++count) {
+		std::vector<uint32_t> pixels = random_pixels(count);
+		std::vector<uint32_t> expected = pixels;
+		reference_unpremultiply(expected.data(), count);
+		oshu_unpremultiply(pixels.data(), count);
+		if (pixels != expected) {
+			std::cerr << "unpremultiplying " << count << " pixels failed" << std::endl;
+			++failures;
+		}
+	}
+	return failures;
+}
+
+/**
+ * Time both loops on a 1400×1000 surface, which is about the size of a long
+ * slider in a 1440p window.
+ */
+static void benchmark()
+{
+	const size_t count = 1400 * 1000;
+	const int rounds = 50;
+	std::vector<uint32_t> source = random_pixels(count);
+	std::vector<uint32_t> pixels(count);
+	auto time = [&](void (*unpremultiply)(uint32_t*, size_t)) {
+		std::chrono::duration<double, std::milli> elapsed {0};
+		for (int i = 0; i < rounds; ++i) {
+			pixels = source;
+			auto start = std::chrono::steady_clock::now();
+			unpremultiply(pixels.data(), count);
+			elapsed += std::chrono::steady_clock::now() - start;
+		}
+		return elapsed.count() / rounds;
+	};
+	double reference = time(reference_unpremultiply);
+	double optimized = time(oshu_unpremultiply);
+	std::cout << "reference unpremultiply: " << reference << " ms per surface" << std::endl;
+	std::cout << "oshu_unpremultiply: " << optimized << " ms per surface" << std::endl;
+}
+
+int main()
+{
+	int failures = check_unpremultiply();
+	benchmark();
+	if (failures > 0)
+		std::cerr << "Total: " << failures << " failed tests." << std::endl;
+	return failures;
+}
@@ -1,23 +1,157 @@
 #include "beatmap/beatmap.h"
 
+#include <ftw.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 
 #include <iostream>
 
+static const char *beatmap_path = "Kaori Oda - Zero Tokei (Short ver.) (ShogunMoon) [Shining].osu";
+
+static int check_beatmap(oshu_beatmap &b)
+{
+	int failures = 0;
+	if (std::strcmp(b.metadata.title, "Zero Tokei (Short ver.)")) {
+		std::cerr << "unexpected title: " << b.metadata.title << std::endl;
+		++failures;
+	}
+	if (std::strcmp(b.audio_filename, "audio.mp3")) {
+		std::cerr << "unexpected audio file name: " << b.audio_filename << std::endl;
+		++failures;
+	}
+	if (!b.background_filename || std::strcmp(b.background_filename, "bg1.jpg")) {
+		std::cerr << "unexpected background file name" << std::endl;
+		++failures;
+	}
+	for (oshu_hit *hit = b.hits; hit; hit = hit->next) {
+		if (hit->index >= b.table.size || b.table.hits[hit->index] != hit || b.table.time[hit->index] != hit->time) {
+			std::cerr << "hit table mismatch at index " << hit->index << std::endl;
+			++failures;
+			break;
+		}
+	}
+	return failures;
+}
+
+/**
+ * Callback for nftw, to delete the temporary home once the cache is checked.
+ */
+static int remove_entry(const char *path, const struct stat*, int, struct FTW*)
+{
+	if (remove(path) < 0) {
+		std::cerr << "could not remove " << path << ": " << std::strerror(errno) << std::endl;
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Save the beatmap in a temporary cache, and load it back.
+ */
+static int check_cache(oshu_beatmap &b)
+{
+	int failures = 0;
+	char home[] = "/tmp/oshu-test-XXXXXX";
+	if (!mkdtemp(home)) {
+		std::cerr << "could not create a temporary home" << std::endl;
+		return 1;
+	}
+	setenv("OSHU_HOME", home, 1);
+	oshu_beatmap c;
+	if (oshu_load_beatmap_cache(beatmap_path, &c) == 0) {
+		std::cerr << "loaded a cache that was never written" << std::endl;
+		oshu_destroy_beatmap(&c);
+		++failures;
+	}
+	if (oshu_save_beatmap_cache(beatmap_path, &b) < 0) {
+		std::cerr << "could not write the beatmap cache" << std::endl;
+		++failures;
+	} else if (oshu_load_beatmap_cache(beatmap_path, &c) < 0) {
+		std::cerr << "could not load the beatmap cache" << std::endl;
+		++failures;
+	} else {
+		failures += check_beatmap(c);
+		if (c.table.size != b.table.size) {
+			std::cerr << "cached beatmap has " << c.table.size << " hits instead of " << b.table.size << std::endl;
+			++failures;
+		}
+		for (oshu_hit *x = b.hits, *y = c.hits; x && y; x = x->next, y = y->next) {
+			bool same_timing = x->timing_point ? y->timing_point && x->timing_point->offset == y->timing_point->offset : !y->timing_point;
+			if (x->time != y->time || !same_timing) {
+				std::cerr << "cached hit " << y->index << " differs" << std::endl;
+				++failures;
+				break;
+			}
+			if ((x->type & OSHU_SLIDER_HIT) && oshu_path_at(&x->slider.path, .5) != oshu_path_at(&y->slider.path, .5)) {
+				std::cerr << "cached slider " << y->index << " differs" << std::endl;
+				++failures;
+				break;
+			}
+		}
+		oshu_destroy_beatmap(&c);
+	}
+	if (nftw(home, remove_entry, 8, FTW_DEPTH | FTW_PHYS) != 0) {
+		std::cerr << "could not remove the temporary home " << home << std::endl;
+		++failures;
+	}
+	return failures;
+}
+
+/**
+ * Compare the scanned summary to the fully loaded beatmap.
+ */
+static int check_scan(oshu_beatmap &b)
+{
+	oshu_beatmap_info info;
+	if (oshu_scan_beatmap(beatmap_path, &info) < 0) {
+		std::cerr << "could not scan the beatmap" << std::endl;
+		return 1;
+	}
+	int failures = 0;
+	if (std::strcmp(info.title, b.metadata.title) || std::strcmp(info.difficulty_name, b.metadata.version)) {
+		std::cerr << "scanned metadata differ" << std::endl;
+		++failures;
+	}
+	if (std::strcmp(info.audio_filename, b.audio_filename)) {
+		std::cerr << "scanned audio file name differs: " << info.audio_filename << std::endl;
+		++failures;
+	}
+	if (info.difficulty.overall_difficulty != b.difficulty.overall_difficulty || info.mode != b.mode) {
+		std::cerr << "scanned difficulty differs" << std::endl;
+		++failures;
+	}
+	return failures;
+}
+
 int main()
 {
 	int failures = 0;
 	int rc;
 	oshu_beatmap b;
-	rc = oshu_load_beatmap("Kaori Oda - Zero Tokei (Short ver.) (ShogunMoon) [Shining].osu", &b);
+	oshu_beatmap m;
+	rc = oshu_load_beatmap(beatmap_path, &b);
 	if (rc < 0) {
 		++failures;
 		goto abort;
 	}
-	if (std::strcmp(b.metadata.title, "Zero Tokei (Short ver.)")) {
-		std::cerr << "unexpected title: " << b.metadata.title << std::endl;
+	failures += check_beatmap(b);
+	rc = oshu_map_beatmap(beatmap_path, &m);
+	if (rc < 0) {
+		std::cerr << "could not map the beatmap" << std::endl;
+		++failures;
+		goto abort;
+	}
+	failures += check_beatmap(m);
+	if (std::strcmp(m.metadata.title_unicode, b.metadata.title_unicode)) {
+		std::cerr << "mapped beatmap has a different unicode title" << std::endl;
 		++failures;
 	}
+	oshu_destroy_beatmap(&m);
+	failures += check_cache(b);
+	failures += check_scan(b);
 	if (failures > 0)
 		std::cerr << "Total: " << failures << " failed tests." << std::endl;
 abort: